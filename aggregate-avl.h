@@ -0,0 +1,252 @@
+#ifndef AGGREGATE_AVL_H
+#define AGGREGATE_AVL_H
+
+#include <iostream>
+#include <exception>
+#include <cstdlib>
+#include <limits>
+#include "avlbst.h"
+
+/**
+* Aggregate policies for AggregateAVLTree. A policy names the summary type
+* and supplies an identity, the summary of a single item (lift) and an
+* associative combine; combine need not be commutative, it is always called
+* with the smaller keys on the left.
+*/
+template <typename Key, typename Value>
+struct SumAggregate
+{
+    typedef Value type;
+    static type identity() { return Value(); }
+    static type lift(const Key&, const Value& value) { return value; }
+    static type combine(const type& a, const type& b) { return a + b; }
+};
+
+template <typename Key, typename Value>
+struct MinAggregate
+{
+    static_assert(std::numeric_limits<Value>::is_specialized,
+                  "MinAggregate needs numeric_limits<Value>::max() as its identity");
+    typedef Value type;
+    static type identity() { return std::numeric_limits<Value>::max(); }
+    static type lift(const Key&, const Value& value) { return value; }
+    static type combine(const type& a, const type& b) { return b < a ? b : a; }
+};
+
+/**
+* With intervals keyed by their start and the end as the value, the max
+* over the starts in [lo, hi] tells whether any of them reaches past a point.
+*/
+template <typename Key, typename Value>
+struct MaxAggregate
+{
+    static_assert(std::numeric_limits<Value>::is_specialized,
+                  "MaxAggregate needs numeric_limits<Value>::lowest() as its identity");
+    typedef Value type;
+    static type identity() { return std::numeric_limits<Value>::lowest(); }
+    static type lift(const Key&, const Value& value) { return value; }
+    static type combine(const type& a, const type& b) { return a < b ? b : a; }
+};
+
+/**
+* An AVLNode that also stores the aggregate of its whole subtree.
+*/
+template <typename Key, typename Value, typename Summary>
+class AggregateAVLNode : public AVLNode<Key, Value>
+{
+public:
+    AggregateAVLNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent);
+    virtual ~AggregateAVLNode();
+
+    const Summary& getSummary() const;
+    void setSummary(const Summary& summary);
+
+    virtual AggregateAVLNode<Key, Value, Summary>* clone(Node<Key, Value>* parent) const override;
+    virtual size_t footprint() const override;
+
+protected:
+    Summary summary_;
+};
+
+/*
+  ----------------------------------------------------
+  Begin implementations for the AggregateAVLNode class.
+  ----------------------------------------------------
+*/
+
+template<class Key, class Value, class Summary>
+AggregateAVLNode<Key, Value, Summary>::AggregateAVLNode(const Key& key, const Value& value,
+                                                        AVLNode<Key, Value>* parent) :
+    AVLNode<Key, Value>(key, value, parent), summary_()
+{
+
+}
+
+template<class Key, class Value, class Summary>
+AggregateAVLNode<Key, Value, Summary>::~AggregateAVLNode()
+{
+
+}
+
+template<class Key, class Value, class Summary>
+const Summary& AggregateAVLNode<Key, Value, Summary>::getSummary() const
+{
+    return summary_;
+}
+
+template<class Key, class Value, class Summary>
+void AggregateAVLNode<Key, Value, Summary>::setSummary(const Summary& summary)
+{
+    summary_ = summary;
+}
+
+template<class Key, class Value, class Summary>
+AggregateAVLNode<Key, Value, Summary>*
+AggregateAVLNode<Key, Value, Summary>::clone(Node<Key, Value>* parent) const
+{
+    AggregateAVLNode<Key, Value, Summary>* node =
+        new AggregateAVLNode<Key, Value, Summary>(this->getKey(), this->getValue(),
+                                                  static_cast<AVLNode<Key, Value>*>(parent));
+    node->setBalance(this->getBalance());
+    node->summary_ = summary_;
+    return node;
+}
+
+template<class Key, class Value, class Summary>
+size_t AggregateAVLNode<Key, Value, Summary>::footprint() const
+{
+    return sizeof(*this);
+}
+
+/*
+  --------------------------------------------------
+  End implementations for the AggregateAVLNode class.
+  --------------------------------------------------
+*/
+
+/**
+* An AVLTree that keeps Aggregate::combine of every subtree in its root, so
+* that the aggregate over any key range takes O(log n). The summaries are
+* maintained through the AVLTree hooks: on the path above every insert,
+* overwrite and removal, and on the two nodes of every rotation.
+*
+* Values changed in place through operator[] or an iterator are not seen;
+* overwrite them with insert() instead. Inside a begin_bulk() session the
+* summaries are stale until end_bulk() recomputes them.
+*/
+template <class Key, class Value, class Aggregate = SumAggregate<Key, Value> >
+class AggregateAVLTree : public AVLTree<Key, Value>
+{
+public:
+    typedef typename Aggregate::type Summary;
+
+    // Aggregate of the items with lo <= key <= hi, in key order
+    Summary aggregate(const Key& lo, const Key& hi) const;
+
+protected:
+    typedef AggregateAVLNode<Key, Value, Summary> SummaryNode;
+
+    virtual AVLNode<Key,Value>* createNode(const Key& key, const Value& value, AVLNode<Key,Value>* parent);
+    virtual void updateNode(AVLNode<Key,Value>* node);
+    virtual void updatePath(AVLNode<Key,Value>* node);
+    static Summary summaryOf(Node<Key,Value>* node);
+};
+
+/*
+  ----------------------------------------------------
+  Begin implementations for the AggregateAVLTree class.
+  ----------------------------------------------------
+*/
+
+/*
+ * Descends to the first node inside [lo, hi], where the searches for lo and
+ * hi split. Below it, every node right of the lo path (left of the hi path)
+ * is in range together with its whole right (left) subtree.
+ */
+template<class Key, class Value, class Aggregate>
+typename AggregateAVLTree<Key, Value, Aggregate>::Summary
+AggregateAVLTree<Key, Value, Aggregate>::aggregate(const Key& lo, const Key& hi) const
+{
+    Node<Key,Value>* split = this->root_;
+    while(split != NULL) {
+        if(split->getKey() < lo) split = split->getRight();
+        else if(hi < split->getKey()) split = split->getLeft();
+        else break;
+    }
+    if(split == NULL) return Aggregate::identity();
+
+    Summary left = Aggregate::identity();
+    for(Node<Key,Value>* n = split->getLeft(); n != NULL; ) {
+        if(n->getKey() < lo) {
+            n = n->getRight();
+        }
+        else {
+            Summary here = Aggregate::combine(Aggregate::lift(n->getKey(), n->getValue()),
+                                              summaryOf(n->getRight()));
+            left = Aggregate::combine(here, left);
+            n = n->getLeft();
+        }
+    }
+
+    Summary right = Aggregate::identity();
+    for(Node<Key,Value>* n = split->getRight(); n != NULL; ) {
+        if(hi < n->getKey()) {
+            n = n->getLeft();
+        }
+        else {
+            Summary here = Aggregate::combine(summaryOf(n->getLeft()),
+                                              Aggregate::lift(n->getKey(), n->getValue()));
+            right = Aggregate::combine(right, here);
+            n = n->getRight();
+        }
+    }
+
+    Summary middle = Aggregate::lift(split->getKey(), split->getValue());
+    return Aggregate::combine(left, Aggregate::combine(middle, right));
+}
+
+template<class Key, class Value, class Aggregate>
+AVLNode<Key,Value>* AggregateAVLTree<Key, Value, Aggregate>::createNode(const Key& key, const Value& value,
+                                                                        AVLNode<Key,Value>* parent)
+{
+    SummaryNode* node = new SummaryNode(key, value, parent);
+    node->setSummary(Aggregate::lift(key, value));
+    return node;
+}
+
+template<class Key, class Value, class Aggregate>
+void AggregateAVLTree<Key, Value, Aggregate>::updateNode(AVLNode<Key,Value>* node)
+{
+    Summary mine = Aggregate::lift(node->getKey(), node->getValue());
+    Summary all = Aggregate::combine(summaryOf(node->getLeft()),
+                                     Aggregate::combine(mine, summaryOf(node->getRight())));
+    static_cast<SummaryNode*>(node)->setSummary(all);
+}
+
+/*
+ * A removal that spliced the node's heir into its place calls this where
+ * the heir left; that path passes through the heir's new position too.
+ */
+template<class Key, class Value, class Aggregate>
+void AggregateAVLTree<Key, Value, Aggregate>::updatePath(AVLNode<Key,Value>* node)
+{
+    for(; node != NULL; node = node->getParent()) {
+        updateNode(node);
+    }
+}
+
+template<class Key, class Value, class Aggregate>
+typename AggregateAVLTree<Key, Value, Aggregate>::Summary
+AggregateAVLTree<Key, Value, Aggregate>::summaryOf(Node<Key,Value>* node)
+{
+    if(node == NULL) return Aggregate::identity();
+    return static_cast<SummaryNode*>(node)->getSummary();
+}
+
+/*
+  --------------------------------------------------
+  End implementations for the AggregateAVLTree class.
+  --------------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,331 @@
+#ifndef AVL_JOURNAL_H
+#define AVL_JOURNAL_H
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <cstdio>
+#include <cstdint>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "avlbst.h"
+#include "bst-io.h"
+
+/**
+* Tuning knobs for JournaledAVLTree.
+*/
+struct JournalOptions
+{
+    JournalOptions() :
+        groupCommitRecords(64),
+        syncOnCommit(true),
+        checkpointBytes(64 * 1024 * 1024)
+    {
+
+    }
+
+    // number of buffered updates that triggers a commit (1 = commit every update)
+    size_t groupCommitRecords;
+    // fsync the log on every commit; without it a commit only reaches the page cache
+    bool syncOnCommit;
+    // log size that triggers an automatic checkpoint (0 = only on request)
+    uint64_t checkpointBytes;
+};
+
+/**
+* An AVLTree whose updates are made durable through a write-ahead log.
+*
+* The state lives in two files next to each other:
+*   <path>.snap  a snapshot written by AVLTree::save()
+*   <path>.wal   the updates applied since that snapshot
+*
+* insert() and remove() update the tree and append a record to an in-memory
+* batch; the batch is written (and optionally fsync'ed) to the log as one
+* group commit. checkpoint() writes a new snapshot, atomically renames it
+* into place, fsyncs the directory so that the rename is on disk, and only
+* then truncates the log. Opening replays the log tail on top of
+* the snapshot; a torn record at the end of the log (crash mid-write) is
+* discarded.
+*
+* Every logged update is a "set" or "delete" of one key, so replaying a log
+* over a snapshot that already contains it (crash between the rename and the
+* truncate) gives the same tree.
+*/
+template <typename Key, typename Value>
+class JournaledAVLTree
+{
+public:
+    typedef typename AVLTree<Key, Value>::iterator iterator;
+
+    explicit JournaledAVLTree(const std::string& path, const JournalOptions& options = JournalOptions());
+    virtual ~JournaledAVLTree();
+
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+
+    // write the pending batch to the log (and fsync it if configured)
+    void commit();
+    // snapshot the tree and truncate the log
+    void checkpoint();
+
+    iterator begin() const { return tree_.begin(); }
+    iterator end() const { return tree_.end(); }
+    iterator find(const Key& key) const { return tree_.find(key); }
+    Value const & operator[](const Key& key) const { return tree_[key]; }
+    bool empty() const { return tree_.empty(); }
+    const AVLTree<Key, Value>& tree() const { return tree_; }
+
+    // number of records replayed from the log when the tree was opened
+    size_t replayed() const { return replayed_; }
+
+protected:
+    void replay();
+    // fsync fd, the open file at path; virtual so a test can watch the order
+    virtual void syncFile(int fd, const std::string& path);
+    void syncDirectory(const std::string& path);
+
+private:
+    JournaledAVLTree(const JournaledAVLTree&);
+    JournaledAVLTree& operator=(const JournaledAVLTree&);
+
+    AVLTree<Key, Value> tree_;
+    JournalOptions options_;
+    std::string snapPath_;
+    std::string logPath_;
+    int logFd_;
+    uint64_t logBytes_;
+    std::ostringstream pending_;
+    size_t pendingRecords_;
+    size_t replayed_;
+};
+
+static const char JOURNAL_INSERT = 'I';
+static const char JOURNAL_REMOVE = 'R';
+
+/*
+  ---------------------------------------------------
+  Begin implementations for the JournaledAVLTree class.
+  ---------------------------------------------------
+*/
+
+template<typename Key, typename Value>
+JournaledAVLTree<Key, Value>::JournaledAVLTree(const std::string& path, const JournalOptions& options) :
+    options_(options),
+    snapPath_(path + ".snap"),
+    logPath_(path + ".wal"),
+    logFd_(-1),
+    logBytes_(0),
+    pendingRecords_(0),
+    replayed_(0)
+{
+    std::ifstream snap(snapPath_.c_str(), std::ios::binary);
+    if(snap) {
+        tree_.load(snap);
+    }
+    replay();
+
+    logFd_ = open(logPath_.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if(logFd_ < 0) throw std::runtime_error("cannot open " + logPath_);
+}
+
+template<typename Key, typename Value>
+JournaledAVLTree<Key, Value>::~JournaledAVLTree()
+{
+    try {
+        commit();
+    }
+    catch(...) {
+        // nothing sensible to do in a destructor; the batch is lost
+    }
+    if(logFd_ >= 0) close(logFd_);
+}
+
+/**
+* Applies every complete record of the log to the tree and cuts off a
+* trailing partial or corrupted record so new appends start clean.
+*/
+template<typename Key, typename Value>
+void JournaledAVLTree<Key, Value>::replay()
+{
+    std::ifstream log(logPath_.c_str(), std::ios::binary);
+    if(!log) return;
+    std::stringstream data;
+    data << log.rdbuf();
+    log.close();
+
+    const std::string bytes = data.str();
+    std::istringstream is(bytes);
+    uint64_t good = 0;
+    while(good < bytes.size()) {
+        try {
+            Checksum sum;
+            char op;
+            readRaw(is, &op, 1, sum);
+            Key key = BinaryCodec<Key>::read(is, sum);
+            if(op == JOURNAL_INSERT) {
+                Value value = BinaryCodec<Value>::read(is, sum);
+                uint64_t expected;
+                Checksum unused;
+                readRaw(is, &expected, sizeof(expected), unused);
+                if(expected != sum.value) break;
+                tree_.insert(std::make_pair(key, value));
+            }
+            else if(op == JOURNAL_REMOVE) {
+                uint64_t expected;
+                Checksum unused;
+                readRaw(is, &expected, sizeof(expected), unused);
+                if(expected != sum.value) break;
+                tree_.remove(key);
+            }
+            else {
+                break;
+            }
+        }
+        catch(std::runtime_error&) {
+            break;
+        }
+        good = static_cast<uint64_t>(is.tellg());
+        ++replayed_;
+    }
+
+    if(good < bytes.size()) {
+        if(truncate(logPath_.c_str(), static_cast<off_t>(good)) != 0) {
+            throw std::runtime_error("cannot truncate " + logPath_);
+        }
+    }
+    logBytes_ = good;
+}
+
+template<typename Key, typename Value>
+void JournaledAVLTree<Key, Value>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    tree_.insert(keyValuePair);
+
+    Checksum sum;
+    writeRaw(pending_, &JOURNAL_INSERT, 1, sum);
+    BinaryCodec<Key>::write(pending_, keyValuePair.first, sum);
+    BinaryCodec<Value>::write(pending_, keyValuePair.second, sum);
+    Checksum unused;
+    writeRaw(pending_, &sum.value, sizeof(sum.value), unused);
+
+    if(++pendingRecords_ >= options_.groupCommitRecords) commit();
+}
+
+template<typename Key, typename Value>
+void JournaledAVLTree<Key, Value>::remove(const Key& key)
+{
+    tree_.remove(key);
+
+    Checksum sum;
+    writeRaw(pending_, &JOURNAL_REMOVE, 1, sum);
+    BinaryCodec<Key>::write(pending_, key, sum);
+    Checksum unused;
+    writeRaw(pending_, &sum.value, sizeof(sum.value), unused);
+
+    if(++pendingRecords_ >= options_.groupCommitRecords) commit();
+}
+
+template<typename Key, typename Value>
+void JournaledAVLTree<Key, Value>::commit()
+{
+    if(pendingRecords_ == 0) return;
+
+    const std::string batch = pending_.str();
+    const char* p = batch.data();
+    size_t left = batch.size();
+    while(left > 0) {
+        ssize_t n = write(logFd_, p, left);
+        if(n < 0) {
+            if(errno == EINTR) continue;
+            throw std::runtime_error("write failed: " + logPath_);
+        }
+        p += n;
+        left -= static_cast<size_t>(n);
+    }
+    if(options_.syncOnCommit) syncFile(logFd_, logPath_);
+
+    logBytes_ += batch.size();
+    pending_.str(std::string());
+    pendingRecords_ = 0;
+
+    if(options_.checkpointBytes > 0 && logBytes_ >= options_.checkpointBytes) {
+        checkpoint();
+    }
+}
+
+template<typename Key, typename Value>
+void JournaledAVLTree<Key, Value>::checkpoint()
+{
+    // make sure the log covers everything in the tree before it goes away
+    if(pendingRecords_ > 0) {
+        uint64_t saved = options_.checkpointBytes;
+        options_.checkpointBytes = 0;
+        commit();
+        options_.checkpointBytes = saved;
+    }
+
+    const std::string tmpPath = snapPath_ + ".tmp";
+    tree_.save(tmpPath);
+
+    int fd = open(tmpPath.c_str(), O_RDONLY);
+    if(fd < 0) throw std::runtime_error("cannot open " + tmpPath);
+    try {
+        syncFile(fd, tmpPath);
+    }
+    catch(...) {
+        close(fd);
+        throw;
+    }
+    close(fd);
+
+    if(std::rename(tmpPath.c_str(), snapPath_.c_str()) != 0) {
+        throw std::runtime_error("cannot rename " + tmpPath);
+    }
+    // until the directory entry is on disk a crash can bring back the old
+    // snapshot, and the log must still be there to replay on top of it
+    syncDirectory(snapPath_);
+    if(ftruncate(logFd_, 0) != 0) {
+        throw std::runtime_error("cannot truncate " + logPath_);
+    }
+    syncFile(logFd_, logPath_);
+    logBytes_ = 0;
+}
+
+template<typename Key, typename Value>
+void JournaledAVLTree<Key, Value>::syncFile(int fd, const std::string& path)
+{
+    if(fsync(fd) != 0) throw std::runtime_error("fsync failed: " + path);
+}
+
+// ----- Helper: fsync the directory that holds path, making renames in it durable -----
+template<typename Key, typename Value>
+void JournaledAVLTree<Key, Value>::syncDirectory(const std::string& path)
+{
+    std::string::size_type slash = path.rfind('/');
+    std::string dir = (slash == std::string::npos) ? "." : (slash == 0 ? "/" : path.substr(0, slash));
+
+    int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if(fd < 0) throw std::runtime_error("cannot open " + dir);
+    try {
+        syncFile(fd, dir);
+    }
+    catch(...) {
+        close(fd);
+        throw;
+    }
+    close(fd);
+}
+
+/*
+  -------------------------------------------------
+  End implementations for the JournaledAVLTree class.
+  -------------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,244 @@
+#ifndef AVL_SET_H
+#define AVL_SET_H
+
+#include <iostream>
+#include <exception>
+#include <cstdlib>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "bst.h"
+#include "avlbst.h"
+
+/**
+* The Value of the trees behind the sets: an empty tag. Set nodes do not
+* store it at all (see SetItem).
+*/
+struct SetSlot
+{
+};
+
+// The tree printers show an item's key and value; a set has no value to show
+inline std::ostream& operator<<(std::ostream& os, const SetSlot&)
+{
+    return os;
+}
+
+/**
+* The item of a set node: the key alone. second is static, so the tree code
+* still finds a SetSlot where a map keeps its value, but no node stores one.
+* Node keeps its item last, so with keys of 4 bytes or less an AVLNode fits
+* its balance into the padding after the key: 40 bytes on 64-bit, one
+* malloc size class (64 down to 48 bytes on glibc) under a map with char
+* values.
+*/
+template <typename Key>
+struct SetItem
+{
+    SetItem(const Key& key, const SetSlot&) : first(key) {}
+
+    const Key first;
+    static SetSlot second;
+};
+
+template <typename Key>
+SetSlot SetItem<Key>::second;
+
+template <typename Key>
+struct NodeItem<Key, SetSlot>
+{
+    typedef SetItem<Key> type;
+};
+
+/**
+* A set of keys on top of a map tree with SetSlot values: the balancing,
+* removal, erase, copies and the rest all come from Tree. Tree is a private
+* base, so none of its map style interface (items, values, operator[]) is
+* visible; the iterator yields the keys.
+*/
+template <class Key, class Tree>
+class TreeSet : private Tree
+{
+public:
+    class iterator
+    {
+    public:
+        iterator();
+
+        const Key& operator*() const;
+        const Key* operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+
+    protected:
+        friend class TreeSet<Key, Tree>;
+        explicit iterator(const typename Tree::iterator& it);
+        typename Tree::iterator it_;
+    };
+
+    void swap(TreeSet& other);
+
+    void insert(const Key& key);
+    using Tree::remove;
+    using Tree::clear;
+    using Tree::size;
+    using Tree::empty;
+    using Tree::isBalanced;
+    using Tree::analyze;
+    using Tree::memory_usage;
+
+    bool contains(const Key& key) const;
+    // out[i] tells whether keys[i] is in the set; the searches are
+    // interleaved as in find_many()
+    void contains_many(const std::vector<Key>& keys, std::vector<bool>& out) const;
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    iterator erase(iterator pos);
+    iterator erase(iterator first, iterator last);
+};
+
+template <class Key>
+class AVLSet : public TreeSet<Key, AVLTree<Key, SetSlot> >
+{
+};
+
+template <class Key>
+class BSTSet : public TreeSet<Key, BinarySearchTree<Key, SetSlot> >
+{
+};
+
+/*
+  ---------------------------------------------------
+  Begin implementations for the TreeSet::iterator class.
+  ---------------------------------------------------
+*/
+
+template<class Key, class Tree>
+TreeSet<Key, Tree>::iterator::iterator() :
+    it_()
+{
+
+}
+
+template<class Key, class Tree>
+TreeSet<Key, Tree>::iterator::iterator(const typename Tree::iterator& it) :
+    it_(it)
+{
+
+}
+
+template<class Key, class Tree>
+const Key& TreeSet<Key, Tree>::iterator::operator*() const
+{
+    return it_->first;
+}
+
+template<class Key, class Tree>
+const Key* TreeSet<Key, Tree>::iterator::operator->() const
+{
+    return &(it_->first);
+}
+
+template<class Key, class Tree>
+bool TreeSet<Key, Tree>::iterator::operator==(const iterator& rhs) const
+{
+    return it_ == rhs.it_;
+}
+
+template<class Key, class Tree>
+bool TreeSet<Key, Tree>::iterator::operator!=(const iterator& rhs) const
+{
+    return it_ != rhs.it_;
+}
+
+template<class Key, class Tree>
+typename TreeSet<Key, Tree>::iterator& TreeSet<Key, Tree>::iterator::operator++()
+{
+    ++it_;
+    return *this;
+}
+
+/*
+  -------------------------------------------------
+  End implementations for the TreeSet::iterator class.
+  -------------------------------------------------
+*/
+
+/*
+  -----------------------------------------
+  Begin implementations for the TreeSet class.
+  -----------------------------------------
+*/
+
+template<class Key, class Tree>
+void TreeSet<Key, Tree>::swap(TreeSet& other)
+{
+    Tree::swap(other);
+}
+
+template<class Key, class Tree>
+void TreeSet<Key, Tree>::insert(const Key& key)
+{
+    Tree::insert(std::make_pair(key, SetSlot()));
+}
+
+template<class Key, class Tree>
+bool TreeSet<Key, Tree>::contains(const Key& key) const
+{
+    return this->internalFind(key) != NULL;
+}
+
+template<class Key, class Tree>
+void TreeSet<Key, Tree>::contains_many(const std::vector<Key>& keys, std::vector<bool>& out) const
+{
+    std::vector<typename Tree::iterator> found;
+    Tree::find_many(keys, found);
+    out.resize(keys.size());
+    typename Tree::iterator none = Tree::end();
+    for(size_t i = 0; i < keys.size(); ++i) {
+        out[i] = (found[i] != none);
+    }
+}
+
+template<class Key, class Tree>
+typename TreeSet<Key, Tree>::iterator TreeSet<Key, Tree>::begin() const
+{
+    return iterator(Tree::begin());
+}
+
+template<class Key, class Tree>
+typename TreeSet<Key, Tree>::iterator TreeSet<Key, Tree>::end() const
+{
+    return iterator(Tree::end());
+}
+
+template<class Key, class Tree>
+typename TreeSet<Key, Tree>::iterator TreeSet<Key, Tree>::find(const Key& key) const
+{
+    return iterator(Tree::find(key));
+}
+
+template<class Key, class Tree>
+typename TreeSet<Key, Tree>::iterator TreeSet<Key, Tree>::erase(iterator pos)
+{
+    return iterator(Tree::erase(pos.it_));
+}
+
+template<class Key, class Tree>
+typename TreeSet<Key, Tree>::iterator TreeSet<Key, Tree>::erase(iterator first, iterator last)
+{
+    return iterator(Tree::erase(first.it_, last.it_));
+}
+
+/*
+  ---------------------------------------
+  End implementations for the TreeSet class.
+  ---------------------------------------
+*/
+
+#endif
@@ -0,0 +1,444 @@
+#ifndef BOUNDED_AVL_H
+#define BOUNDED_AVL_H
+
+#include <iostream>
+#include <exception>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <string>
+#include "avlbst.h"
+
+/**
+* An AVLNode that also remembers the bytes it was charged for, so that a
+* removal gives back exactly what the insert took even if the value changed
+* in place since. The field fits in the padding after the balance, so the
+* node is no larger than a plain AVLNode.
+*/
+template <typename Key, typename Value>
+class BoundedAVLNode : public AVLNode<Key, Value>
+{
+public:
+    BoundedAVLNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent);
+    virtual ~BoundedAVLNode();
+
+    size_t getBytes() const;
+    void setBytes(size_t bytes);
+
+    virtual BoundedAVLNode<Key, Value>* clone(Node<Key, Value>* parent) const override;
+    virtual size_t footprint() const override;
+
+protected:
+    uint32_t bytes_;
+};
+
+/*
+  --------------------------------------------------
+  Begin implementations for the BoundedAVLNode class.
+  --------------------------------------------------
+*/
+
+template<class Key, class Value>
+BoundedAVLNode<Key, Value>::BoundedAVLNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent) :
+    AVLNode<Key, Value>(key, value, parent), bytes_(0)
+{
+
+}
+
+template<class Key, class Value>
+BoundedAVLNode<Key, Value>::~BoundedAVLNode()
+{
+
+}
+
+template<class Key, class Value>
+size_t BoundedAVLNode<Key, Value>::getBytes() const
+{
+    return bytes_;
+}
+
+// Items of 4GB or more are charged 4GB
+template<class Key, class Value>
+void BoundedAVLNode<Key, Value>::setBytes(size_t bytes)
+{
+    uint32_t most = std::numeric_limits<uint32_t>::max();
+    bytes_ = bytes > most ? most : static_cast<uint32_t>(bytes);
+}
+
+template<class Key, class Value>
+BoundedAVLNode<Key, Value>* BoundedAVLNode<Key, Value>::clone(Node<Key, Value>* parent) const
+{
+    BoundedAVLNode<Key, Value>* node =
+        new BoundedAVLNode<Key, Value>(this->getKey(), this->getValue(), static_cast<AVLNode<Key, Value>*>(parent));
+    node->setBalance(this->getBalance());
+    node->bytes_ = bytes_;
+    return node;
+}
+
+template<class Key, class Value>
+size_t BoundedAVLNode<Key, Value>::footprint() const
+{
+    return sizeof(*this);
+}
+
+/*
+  ------------------------------------------------
+  End implementations for the BoundedAVLNode class.
+  ------------------------------------------------
+*/
+
+/**
+* An AVLTree with a capacity: at most maxEntries items and at most maxBytes
+* bytes, where an item costs its node, the malloc slack around it and
+* whatever heapBytes(key, value) reports for memory it owns (a string's
+* capacity, say). A limit of 0 is no limit. When an insert goes over a
+* limit, the items with the smallest keys are evicted. With the expiry time
+* (or the insertion time) as the key, or leading a (time, id) pair, that is
+* the oldest entries, and expire(now) drops the ones whose time has passed.
+*
+* Each eviction is a pop_front(): the smallest node is cached and never has
+* a left child, so it is unlinked without a search and retraced in O(log n)
+* at worst, O(1) amortized. An insert only evicts what it must to get back
+* under the limits, usually one item, so a write never pays for more than
+* its own share. evict() cuts the map down to (1 - batch) of the limits in
+* one go; called off the write path (from a timer, say) it leaves the next
+* batch worth of inserts with nothing to evict. Doing the batches inside
+* insert() instead turned out slower on bst-perf (a node freed and
+* reallocated right away stays in the cache) and made every batch-th write
+* a long one.
+*
+* The bytes are measured when an item is inserted or overwritten through
+* insert(). Values changed in place through operator[] or an iterator are
+* not seen, and neither are overwrites inside a begin_bulk() session.
+*/
+template <class Key, class Value>
+class BoundedAVLTree : public AVLTree<Key, Value>
+{
+public:
+    typedef typename AVLTree<Key, Value>::iterator iterator;
+    typedef std::function<size_t(const Key&, const Value&)> HeapBytes;
+
+    explicit BoundedAVLTree(size_t maxEntries, size_t maxBytes = 0,
+                            HeapBytes heapBytes = HeapBytes(), double batch = 1.0 / 64);
+    BoundedAVLTree(const BoundedAVLTree& other);
+    BoundedAVLTree(BoundedAVLTree&& other);
+    BoundedAVLTree& operator=(const BoundedAVLTree& other);
+    BoundedAVLTree& operator=(BoundedAVLTree&& other);
+    void swap(BoundedAVLTree& other);
+
+    virtual void insert(const std::pair<const Key, Value> &new_item);
+    // Returns end() if the new item was itself evicted
+    iterator insert(iterator hint, const std::pair<const Key, Value> &new_item);
+    void append_back(const std::pair<const Key, Value> &new_item);
+    virtual void clear();
+
+    virtual void load(std::istream& is);
+    void load(const std::string& path);
+
+    // Lowering a limit evicts right away
+    void setLimits(size_t maxEntries, size_t maxBytes);
+    size_t maxEntries() const;
+    size_t maxBytes() const;
+    size_t bytes() const;
+    // Items evicted so far, by the limits or by evict(); not by expire()
+    size_t evictions() const;
+
+    // Evicts down to (1 - batch) of the limits; returns the items evicted
+    size_t evict();
+    // Removes every item with a key less than key; returns how many
+    size_t expire(const Key& key);
+
+protected:
+    virtual AVLNode<Key,Value>* createNode(const Key& key, const Value& value, AVLNode<Key,Value>* parent);
+    virtual void updatePath(AVLNode<Key,Value>* node);
+    virtual void removeNode(Node<Key,Value>* node, bool bySuccessor);
+
+    size_t measure(const Node<Key, Value>* node) const;
+    bool overLimit() const;
+    size_t evictTo(size_t entries, size_t bytes);
+    void recount();
+
+    size_t maxEntries_;
+    size_t maxBytes_;
+    HeapBytes heapBytes_;
+    double batch_;
+    size_t bytes_;
+    size_t evictions_;
+    mutable size_t nodeBytes_;
+    // The node createNode() just measured, which updatePath() need not redo
+    BoundedAVLNode<Key, Value>* fresh_;
+    // Set while a node is unlinked, when updatePath() has nothing to measure
+    bool removing_;
+};
+
+/*
+  --------------------------------------------------
+  Begin implementations for the BoundedAVLTree class.
+  --------------------------------------------------
+*/
+
+template<class Key, class Value>
+BoundedAVLTree<Key, Value>::BoundedAVLTree(size_t maxEntries, size_t maxBytes,
+                                           HeapBytes heapBytes, double batch) :
+    AVLTree<Key, Value>(), maxEntries_(maxEntries), maxBytes_(maxBytes), heapBytes_(heapBytes),
+    batch_(batch), bytes_(0), evictions_(0), nodeBytes_(0), fresh_(NULL), removing_(false)
+{
+    if(!(batch >= 0.0 && batch < 1.0)) throw std::invalid_argument("batch must be in [0, 1)");
+}
+
+template<class Key, class Value>
+BoundedAVLTree<Key, Value>::BoundedAVLTree(const BoundedAVLTree& other) :
+    AVLTree<Key, Value>(other), maxEntries_(other.maxEntries_), maxBytes_(other.maxBytes_),
+    heapBytes_(other.heapBytes_), batch_(other.batch_), bytes_(other.bytes_),
+    evictions_(other.evictions_), nodeBytes_(other.nodeBytes_), fresh_(NULL), removing_(false)
+{
+
+}
+
+template<class Key, class Value>
+BoundedAVLTree<Key, Value>::BoundedAVLTree(BoundedAVLTree&& other) :
+    AVLTree<Key, Value>(std::move(other)), maxEntries_(other.maxEntries_), maxBytes_(other.maxBytes_),
+    heapBytes_(other.heapBytes_), batch_(other.batch_), bytes_(other.bytes_),
+    evictions_(other.evictions_), nodeBytes_(other.nodeBytes_), fresh_(NULL), removing_(false)
+{
+    other.bytes_ = 0;
+    other.evictions_ = 0;
+}
+
+template<class Key, class Value>
+BoundedAVLTree<Key, Value>& BoundedAVLTree<Key, Value>::operator=(const BoundedAVLTree& other)
+{
+    if(this != &other) {
+        BoundedAVLTree<Key, Value> copy(other);
+        swap(copy);
+    }
+    return *this;
+}
+
+template<class Key, class Value>
+BoundedAVLTree<Key, Value>& BoundedAVLTree<Key, Value>::operator=(BoundedAVLTree&& other)
+{
+    if(this != &other) {
+        clear();
+        swap(other);
+    }
+    return *this;
+}
+
+template<class Key, class Value>
+void BoundedAVLTree<Key, Value>::swap(BoundedAVLTree& other)
+{
+    AVLTree<Key, Value>::swap(other);
+    std::swap(maxEntries_, other.maxEntries_);
+    std::swap(maxBytes_, other.maxBytes_);
+    std::swap(heapBytes_, other.heapBytes_);
+    std::swap(batch_, other.batch_);
+    std::swap(bytes_, other.bytes_);
+    std::swap(evictions_, other.evictions_);
+    std::swap(nodeBytes_, other.nodeBytes_);
+}
+
+template<class Key, class Value>
+void BoundedAVLTree<Key, Value>::insert(const std::pair<const Key, Value> &new_item)
+{
+    AVLTree<Key, Value>::insert(new_item);
+    if(overLimit()) evictTo(maxEntries_, maxBytes_);
+}
+
+template<class Key, class Value>
+typename BoundedAVLTree<Key, Value>::iterator
+BoundedAVLTree<Key, Value>::insert(iterator hint, const std::pair<const Key, Value> &new_item)
+{
+    iterator it = AVLTree<Key, Value>::insert(hint, new_item);
+    if(!overLimit()) return it;
+    // evictions take a prefix of the keys and leave the other nodes where
+    // they are, so the new item is gone only if it now sorts before them all
+    Key key = new_item.first;
+    evictTo(maxEntries_, maxBytes_);
+    if(this->leftmost_ == NULL || key < this->leftmost_->getKey()) return this->end();
+    return it;
+}
+
+template<class Key, class Value>
+void BoundedAVLTree<Key, Value>::append_back(const std::pair<const Key, Value> &new_item)
+{
+    AVLTree<Key, Value>::append_back(new_item);
+    if(overLimit()) evictTo(maxEntries_, maxBytes_);
+}
+
+template<class Key, class Value>
+void BoundedAVLTree<Key, Value>::clear()
+{
+    AVLTree<Key, Value>::clear();
+    bytes_ = 0;
+    fresh_ = NULL;
+}
+
+/*
+ * AVLTree::load() builds the new nodes before it frees the old ones, so the
+ * bytes are counted again from whichever tree is left, and a snapshot
+ * larger than the limits is cut down right away.
+ */
+template<class Key, class Value>
+void BoundedAVLTree<Key, Value>::load(std::istream& is)
+{
+    try {
+        AVLTree<Key, Value>::load(is);
+    }
+    catch(...) {
+        recount();
+        throw;
+    }
+    recount();
+    if(overLimit()) evictTo(maxEntries_, maxBytes_);
+}
+
+template<class Key, class Value>
+void BoundedAVLTree<Key, Value>::load(const std::string& path)
+{
+    std::ifstream ifile(path.c_str(), std::ios::binary);
+    if(!ifile) throw std::runtime_error("cannot open " + path);
+    load(ifile);
+}
+
+template<class Key, class Value>
+void BoundedAVLTree<Key, Value>::setLimits(size_t maxEntries, size_t maxBytes)
+{
+    maxEntries_ = maxEntries;
+    maxBytes_ = maxBytes;
+    if(overLimit()) evictTo(maxEntries_, maxBytes_);
+}
+
+template<class Key, class Value>
+size_t BoundedAVLTree<Key, Value>::maxEntries() const
+{
+    return maxEntries_;
+}
+
+template<class Key, class Value>
+size_t BoundedAVLTree<Key, Value>::maxBytes() const
+{
+    return maxBytes_;
+}
+
+template<class Key, class Value>
+size_t BoundedAVLTree<Key, Value>::bytes() const
+{
+    return bytes_;
+}
+
+template<class Key, class Value>
+size_t BoundedAVLTree<Key, Value>::evictions() const
+{
+    return evictions_;
+}
+
+template<class Key, class Value>
+size_t BoundedAVLTree<Key, Value>::evict()
+{
+    return evictTo(maxEntries_ - static_cast<size_t>(maxEntries_ * batch_),
+                   maxBytes_ - static_cast<size_t>(maxBytes_ * batch_));
+}
+
+template<class Key, class Value>
+size_t BoundedAVLTree<Key, Value>::expire(const Key& key)
+{
+    size_t expired = 0;
+    while(this->leftmost_ != NULL && this->leftmost_->getKey() < key) {
+        this->pop_front();
+        ++expired;
+    }
+    return expired;
+}
+
+template<class Key, class Value>
+AVLNode<Key,Value>* BoundedAVLTree<Key, Value>::createNode(const Key& key, const Value& value,
+                                                           AVLNode<Key,Value>* parent)
+{
+    BoundedAVLNode<Key, Value>* node = new BoundedAVLNode<Key, Value>(key, value, parent);
+    node->setBytes(measure(node));
+    bytes_ += node->getBytes();
+    // in bulk mode updatePath() is not called to clear it again
+    if(!this->bulk_) fresh_ = node;
+    return node;
+}
+
+// Called on a new node, an overwritten one or the parent of a removed one;
+// only an overwrite can change what a node costs
+template<class Key, class Value>
+void BoundedAVLTree<Key, Value>::updatePath(AVLNode<Key,Value>* node)
+{
+    BoundedAVLNode<Key, Value>* bounded = static_cast<BoundedAVLNode<Key, Value>*>(node);
+    if(removing_) return;
+    if(bounded == fresh_) {
+        fresh_ = NULL;
+        return;
+    }
+    bytes_ -= bounded->getBytes();
+    bounded->setBytes(measure(bounded));
+    bytes_ += bounded->getBytes();
+}
+
+template<class Key, class Value>
+void BoundedAVLTree<Key, Value>::removeNode(Node<Key,Value>* node, bool bySuccessor)
+{
+    BoundedAVLNode<Key, Value>* bounded = static_cast<BoundedAVLNode<Key, Value>*>(node);
+    if(bounded == fresh_) fresh_ = NULL;
+    bytes_ -= bounded->getBytes();
+    removing_ = true;
+    AVLTree<Key, Value>::removeNode(node, bySuccessor);
+    removing_ = false;
+}
+
+// ----- Helper: what one item costs against maxBytes -----
+template<class Key, class Value>
+size_t BoundedAVLTree<Key, Value>::measure(const Node<Key, Value>* node) const
+{
+    // every node has the same type and size class, so the first one stands for all
+    if(nodeBytes_ == 0) nodeBytes_ = node->footprint() + BinarySearchTree<Key, Value>::allocationSlack(node);
+    if(!heapBytes_) return nodeBytes_;
+    return nodeBytes_ + heapBytes_(node->getKey(), node->getValue());
+}
+
+template<class Key, class Value>
+bool BoundedAVLTree<Key, Value>::overLimit() const
+{
+    return (maxEntries_ != 0 && this->count_ > maxEntries_) ||
+           (maxBytes_ != 0 && bytes_ > maxBytes_);
+}
+
+// ----- Helper: drop the smallest keys until the limits given are met -----
+template<class Key, class Value>
+size_t BoundedAVLTree<Key, Value>::evictTo(size_t entries, size_t bytes)
+{
+    size_t evicted = 0;
+    while(this->leftmost_ != NULL &&
+          ((maxEntries_ != 0 && this->count_ > entries) || (maxBytes_ != 0 && bytes_ > bytes))) {
+        this->pop_front();
+        ++evicted;
+    }
+    evictions_ += evicted;
+    return evicted;
+}
+
+template<class Key, class Value>
+void BoundedAVLTree<Key, Value>::recount()
+{
+    bytes_ = 0;
+    fresh_ = NULL;
+    for(Node<Key, Value>* node = this->leftmost_; node != NULL;
+        node = BinarySearchTree<Key, Value>::successor(node)) {
+        bytes_ += static_cast<BoundedAVLNode<Key, Value>*>(node)->getBytes();
+    }
+}
+
+/*
+  ------------------------------------------------
+  End implementations for the BoundedAVLTree class.
+  ------------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,287 @@
+#ifndef BST_IO_H
+#define BST_IO_H
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+* Running FNV-1a 64 bit checksum over everything that passes through the
+* binary codecs below. It is cheap enough to run on every byte of a snapshot
+* and catches truncated or corrupted files.
+*/
+struct Checksum
+{
+    Checksum() : value(14695981039346656037ULL) { }
+
+    void update(const void* data, size_t len)
+    {
+        const unsigned char* p = static_cast<const unsigned char*>(data);
+        for(size_t i = 0; i < len; ++i) {
+            value ^= p[i];
+            value *= 1099511628211ULL;
+        }
+    }
+
+    uint64_t value;
+};
+
+/**
+* Raw helpers used by the codecs: they throw std::runtime_error when the
+* stream fails so callers never have to check the stream state themselves.
+*/
+inline void writeRaw(std::ostream& os, const void* data, size_t len, Checksum& sum)
+{
+    os.write(static_cast<const char*>(data), static_cast<std::streamsize>(len));
+    if(!os) throw std::runtime_error("write failed");
+    sum.update(data, len);
+}
+
+inline void readRaw(std::istream& is, void* data, size_t len, Checksum& sum)
+{
+    is.read(static_cast<char*>(data), static_cast<std::streamsize>(len));
+    if(static_cast<size_t>(is.gcount()) != len) throw std::runtime_error("unexpected end of data");
+    sum.update(data, len);
+}
+
+/**
+* Which types may be written to a snapshot byte for byte: numbers and enums.
+* Other trivially copyable types can opt in by specializing this with
+* value = true, but only if their bytes mean the same thing when read back
+* in another process; a pointer (a const char* key, or a struct holding
+* one) would be saved as a raw address.
+*/
+template <typename T>
+struct RawSnapshot :
+    std::integral_constant<bool, std::is_arithmetic<T>::value || std::is_enum<T>::value>
+{
+};
+
+/**
+* Encodes a single key or value in the snapshot format.
+*
+* RawSnapshot types are copied byte for byte (native endianness),
+* std::string is written as a 64 bit length followed by its characters.
+* Other types can be supported by specializing BinaryCodec<T, false>.
+* read() returns a new object, so every type that is loaded must be
+* default constructible as well as copyable.
+*
+* The primary template stands in for types without a codec: it lets
+* AVLTree::load(), which is virtual and so compiled for every tree, build
+* for them, and throws if it is ever used. save() refuses them at compile
+* time.
+*/
+template <typename T, bool Raw = RawSnapshot<T>::value>
+struct BinaryCodec
+{
+    static const bool supported = false;
+    static const bool fixedSize = false;
+
+    static void write(std::ostream&, const T&, Checksum&)
+    {
+        throw std::runtime_error("no BinaryCodec for this type");
+    }
+
+    static T read(std::istream&, Checksum&)
+    {
+        throw std::runtime_error("no BinaryCodec for this type");
+    }
+};
+
+template <typename T>
+struct BinaryCodec<T, true>
+{
+    static_assert(std::is_trivially_copyable<T>::value, "RawSnapshot types must be trivially copyable");
+    static const bool supported = true;
+    static const bool fixedSize = true;
+
+    static void write(std::ostream& os, const T& item, Checksum& sum)
+    {
+        writeRaw(os, &item, sizeof(T), sum);
+    }
+
+    static T read(std::istream& is, Checksum& sum)
+    {
+        T item;
+        readRaw(is, &item, sizeof(T), sum);
+        return item;
+    }
+};
+
+template <>
+struct BinaryCodec<std::string, false>
+{
+    static const bool supported = true;
+    static const bool fixedSize = false;
+
+    static void write(std::ostream& os, const std::string& item, Checksum& sum)
+    {
+        uint64_t len = item.size();
+        writeRaw(os, &len, sizeof(len), sum);
+        writeRaw(os, item.data(), item.size(), sum);
+    }
+
+    static std::string read(std::istream& is, Checksum& sum)
+    {
+        uint64_t len;
+        readRaw(is, &len, sizeof(len), sum);
+        // read in chunks so a corrupted length fails on end of data
+        // instead of attempting one huge allocation
+        std::string item;
+        char chunk[4096];
+        while(len > 0) {
+            size_t n = len < sizeof(chunk) ? static_cast<size_t>(len) : sizeof(chunk);
+            readRaw(is, chunk, n, sum);
+            item.append(chunk, n);
+            len -= n;
+        }
+        return item;
+    }
+};
+
+/**
+* Writes the (key, value) records of a snapshot one after the other. When
+* both types are fixed size the records are packed into a buffer and
+* written and checksummed up to 64KB at a time, instead of as two small
+* stream writes each; the bytes on disk are the same either way. count is
+* only a size hint for the buffer.
+*/
+template <typename Key, typename Value,
+          bool Packed = BinaryCodec<Key>::fixedSize && BinaryCodec<Value>::fixedSize>
+class RecordWriter
+{
+public:
+    RecordWriter(std::ostream& os, uint64_t, Checksum& sum) : os_(os), sum_(sum) { }
+
+    void write(const Key& key, const Value& value)
+    {
+        BinaryCodec<Key>::write(os_, key, sum_);
+        BinaryCodec<Value>::write(os_, value, sum_);
+    }
+
+    void flush() { }
+
+private:
+    std::ostream& os_;
+    Checksum& sum_;
+};
+
+template <typename Key, typename Value>
+class RecordWriter<Key, Value, true>
+{
+public:
+    static const size_t RECORD_SIZE = sizeof(Key) + sizeof(Value);
+    static const size_t BLOCK_RECORDS = RECORD_SIZE < 65536 ? 65536 / RECORD_SIZE : 1;
+
+    RecordWriter(std::ostream& os, uint64_t count, Checksum& sum) :
+        os_(os), sum_(sum), used_(0), buf_((count < BLOCK_RECORDS ? count : BLOCK_RECORDS) * RECORD_SIZE) { }
+
+    void write(const Key& key, const Value& value)
+    {
+        if(used_ == buf_.size()) flush();
+        std::memcpy(&buf_[used_], &key, sizeof(Key));
+        std::memcpy(&buf_[used_ + sizeof(Key)], &value, sizeof(Value));
+        used_ += RECORD_SIZE;
+    }
+
+    void flush()
+    {
+        if(used_ == 0) return;
+        writeRaw(os_, &buf_[0], used_, sum_);
+        used_ = 0;
+    }
+
+private:
+    std::ostream& os_;
+    Checksum& sum_;
+    size_t used_;
+    std::vector<char> buf_;
+};
+
+/**
+* Reads back count records written by RecordWriter, a block at a time when
+* both types are fixed size. It never reads past the last record, so
+* whatever follows them in the stream is left for the caller.
+*/
+template <typename Key, typename Value,
+          bool Packed = BinaryCodec<Key>::fixedSize && BinaryCodec<Value>::fixedSize>
+class RecordReader
+{
+public:
+    RecordReader(std::istream& is, uint64_t, Checksum& sum) : is_(is), sum_(sum) { }
+
+    std::pair<Key, Value> read()
+    {
+        Key key = BinaryCodec<Key>::read(is_, sum_);
+        Value value = BinaryCodec<Value>::read(is_, sum_);
+        return std::pair<Key, Value>(key, value);
+    }
+
+private:
+    std::istream& is_;
+    Checksum& sum_;
+};
+
+template <typename Key, typename Value>
+class RecordReader<Key, Value, true>
+{
+public:
+    static const size_t RECORD_SIZE = sizeof(Key) + sizeof(Value);
+    static const size_t BLOCK_RECORDS = RECORD_SIZE < 65536 ? 65536 / RECORD_SIZE : 1;
+
+    RecordReader(std::istream& is, uint64_t count, Checksum& sum) :
+        is_(is), sum_(sum), left_(count), pos_(0), end_(0),
+        buf_((count < BLOCK_RECORDS ? count : BLOCK_RECORDS) * RECORD_SIZE) { }
+
+    std::pair<Key, Value> read()
+    {
+        if(pos_ == end_) fill();
+        Key key;
+        Value value;
+        std::memcpy(&key, &buf_[pos_], sizeof(Key));
+        std::memcpy(&value, &buf_[pos_ + sizeof(Key)], sizeof(Value));
+        pos_ += RECORD_SIZE;
+        return std::pair<Key, Value>(key, value);
+    }
+
+private:
+    void fill()
+    {
+        if(left_ == 0) throw std::runtime_error("unexpected end of data");
+        size_t records = left_ < BLOCK_RECORDS ? static_cast<size_t>(left_) : BLOCK_RECORDS;
+        readRaw(is_, &buf_[0], records * RECORD_SIZE, sum_);
+        left_ -= records;
+        pos_ = 0;
+        end_ = records * RECORD_SIZE;
+    }
+
+    std::istream& is_;
+    Checksum& sum_;
+    uint64_t left_;
+    size_t pos_;
+    size_t end_;
+    std::vector<char> buf_;
+};
+
+/**
+* Header written at the start of every tree snapshot.
+*/
+struct SnapshotHeader
+{
+    char magic[4];          // "BSTS"
+    uint16_t version;
+    uint8_t flags;          // bit 0: fixed size keys, bit 1: fixed size values
+    uint8_t reserved;
+    uint32_t keySize;       // sizeof(Key), or 0 if not fixed size
+    uint32_t valueSize;     // sizeof(Value), or 0 if not fixed size
+    uint64_t count;         // number of (key, value) records that follow
+};
+
+static const uint16_t SNAPSHOT_VERSION = 1;
+
+#endif
@@ -0,0 +1,500 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <cstdlib>
+#include <cmath>
+#include <string>
+#include "bst.h"
+#include "avlbst.h"
+#include "compact-avl.h"
+#include "index-avl.h"
+#include "splaybst.h"
+#include "rbbst.h"
+#include "aggregate-avl.h"
+#include "lazy-avl.h"
+#include "parallel-bst.h"
+#include "small-avl.h"
+#include "hashed-avl.h"
+#include "avl-set.h"
+#include "bounded-avl.h"
+#include "perf-counters.h"
+
+using namespace std;
+
+// Profiles the hot tree operations with hardware counters and prints
+// the per-operation averages.
+//   usage: ./bst-perf [num_keys] [seed]
+
+static void report(const char* label, const PerfCounters& pc, uint64_t ops)
+{
+    cout << left << setw(24) << label;
+    for(int c = 0; c < PerfCounters::NUM_COUNTERS; ++c) {
+        PerfCounters::Counter counter = static_cast<PerfCounters::Counter>(c);
+        cout << right << setw(18);
+        if(!pc.isAvailable(counter) || ops == 0) {
+            cout << "n/a";
+        }
+        else {
+            cout << fixed << setprecision(2)
+                 << static_cast<double>(pc.read(counter)) / static_cast<double>(ops);
+        }
+    }
+    cout << endl;
+}
+
+static void header()
+{
+    cout << left << setw(24) << "per operation";
+    for(int c = 0; c < PerfCounters::NUM_COUNTERS; ++c) {
+        cout << right << setw(18) << PerfCounters::name(static_cast<PerfCounters::Counter>(c));
+    }
+    cout << endl;
+}
+
+// Draws count keys from 0..n-1 with Zipf(s) popularity; the popular keys
+// are scattered through the key space rather than being the smallest ones.
+static vector<uint64_t> zipfKeys(uint64_t n, uint64_t count, double s, mt19937& rng)
+{
+    vector<double> cdf(n);
+    double total = 0;
+    for(uint64_t i = 0; i < n; ++i) {
+        total += 1.0 / pow(static_cast<double>(i + 1), s);
+        cdf[i] = total;
+    }
+    vector<uint64_t> rankToKey(n);
+    for(uint64_t i = 0; i < n; ++i) rankToKey[i] = i;
+    shuffle(rankToKey.begin(), rankToKey.end(), rng);
+
+    uniform_real_distribution<double> uniform(0.0, total);
+    vector<uint64_t> out(count);
+    for(uint64_t i = 0; i < count; ++i) {
+        uint64_t rank = lower_bound(cdf.begin(), cdf.end(), uniform(rng)) - cdf.begin();
+        out[i] = rankToKey[rank < n ? rank : n - 1];
+    }
+    return out;
+}
+
+// Draws count keys from 0..n-1 so that a random 5% of the keys get 90% of
+// the draws and the rest share the other 10%.
+static vector<uint64_t> hotSetKeys(uint64_t n, uint64_t count, mt19937& rng)
+{
+    vector<uint64_t> order(n);
+    for(uint64_t i = 0; i < n; ++i) order[i] = i;
+    shuffle(order.begin(), order.end(), rng);
+    uint64_t hot = n / 20 > 0 ? n / 20 : 1;
+
+    vector<uint64_t> out(count);
+    for(uint64_t i = 0; i < count; ++i) {
+        if(rng() % 10 != 0 || hot == n) out[i] = order[rng() % hot];
+        else out[i] = order[hot + rng() % (n - hot)];
+    }
+    return out;
+}
+
+// Runs ops operations on tree, readPercent of them lookups and the rest an
+// even mix of inserts and removes of random keys in 0..2n-1.
+template<typename Tree>
+static uint64_t mixedWorkload(Tree& tree, uint64_t n, uint64_t ops, int readPercent, unsigned seed)
+{
+    mt19937 rng(seed);
+    uint64_t found = 0;
+    for(uint64_t i = 0; i < ops; ++i) {
+        uint64_t key = rng() % (2 * n);
+        int roll = static_cast<int>(rng() % 100);
+        if(roll < readPercent) {
+            found += (tree.find(key) != tree.end());
+        }
+        else if(roll % 2 == 0) {
+            tree.insert(make_pair(key, key));
+        }
+        else {
+            tree.remove(key);
+        }
+    }
+    return found;
+}
+
+// sums the values so the compiler cannot throw the traversal away
+template<typename Tree>
+static uint64_t iterateAll(const Tree& tree)
+{
+    uint64_t sum = 0;
+    for(typename Tree::iterator it = tree.begin(); it != tree.end(); ++it) {
+        sum += it->second;
+    }
+    return sum;
+}
+
+// Everything the benchmarks share: the keys (0..n-1 shuffled), the same
+// keys in another order for lookups, and the counters.
+struct Bench
+{
+    uint64_t n;
+    unsigned seed;
+    vector<uint64_t> keys;
+    vector<uint64_t> lookups;
+    mt19937 rng;
+    PerfCounters pc;
+    // sums results so the compiler cannot throw the work away
+    uint64_t sink;
+};
+
+template<typename Tree>
+static void fill(Tree& tree, const Bench& b)
+{
+    for(uint64_t i = 0; i < b.n; ++i) tree.insert(make_pair(b.keys[i], b.keys[i]));
+}
+
+template<typename Tree>
+static void benchFind(Bench& b, const Tree& tree, const char* label)
+{
+    b.pc.start();
+    for(uint64_t i = 0; i < b.n; ++i) {
+        b.sink += (tree.find(b.lookups[i]) != tree.end());
+    }
+    b.pc.stop();
+    report(label, b.pc, b.n);
+}
+
+template<typename Tree>
+static void benchIteration(Bench& b, const Tree& tree, const char* label)
+{
+    b.pc.start();
+    b.sink += iterateAll(tree);
+    b.pc.stop();
+    report(label, b.pc, b.n);
+}
+
+static void benchBST(Bench& b)
+{
+    BinarySearchTree<uint64_t, uint64_t> bst;
+    fill(bst, b);
+    benchFind(b, bst, "BST::find");
+    benchIteration(b, bst, "BST iteration");
+}
+
+// Lookups, traversals and whole-tree operations on one random AVL tree
+static void benchAVL(Bench& b, AVLTree<uint64_t, uint64_t>& avl)
+{
+    b.pc.start();
+    fill(avl, b);
+    b.pc.stop();
+    report("AVLTree::insert", b.pc, b.n);
+
+    benchFind(b, avl, "AVLTree::find");
+
+    vector<AVLTree<uint64_t, uint64_t>::iterator> found;
+    b.pc.start();
+    avl.find_many(b.lookups, found);
+    b.pc.stop();
+    for(uint64_t i = 0; i < b.n; ++i) b.sink += (found[i] != avl.end());
+    report("AVLTree::find_many", b.pc, b.n);
+
+    benchIteration(b, avl, "AVLTree iteration");
+
+    b.pc.start();
+    b.sink += avl.analyze().size;
+    b.pc.stop();
+    report("AVLTree::analyze", b.pc, b.n);
+
+    b.pc.start();
+    b.sink += avl.analyze(1024).size;
+    b.pc.stop();
+    report("AVLTree::analyze(1024)", b.pc, 1024);
+
+    // counters cover the calling thread only, so this shows its share
+    b.pc.start();
+    b.sink += parallel_reduce(avl, uint64_t(0),
+                              [](const pair<const uint64_t, uint64_t>& item) { return item.second; },
+                              [](uint64_t x, uint64_t y) { return x + y; });
+    b.pc.stop();
+    report("AVLTree parallel_reduce", b.pc, b.n);
+
+    b.pc.start();
+    {
+        AVLTree<uint64_t, uint64_t> copy(avl);
+        b.sink += copy.back().first;
+    }
+    b.pc.stop();
+    report("AVLTree copy+destroy", b.pc, b.n);
+}
+
+// Ways of building a tree: bulk mode, sorted keys and append_back
+static void benchAVLBuild(Bench& b)
+{
+    AVLTree<uint64_t, uint64_t> bulk;
+    b.pc.start();
+    bulk.begin_bulk();
+    fill(bulk, b);
+    bulk.end_bulk();
+    b.pc.stop();
+    report("AVLTree bulk, unsorted", b.pc, b.n);
+
+    // the way bulk mode is meant to be used: sort the batch, then load it
+    AVLTree<uint64_t, uint64_t> sortedBulk;
+    b.pc.start();
+    {
+        std::vector<uint64_t> batch(b.keys.begin(), b.keys.begin() + b.n);
+        std::sort(batch.begin(), batch.end());
+        sortedBulk.begin_bulk();
+        for(uint64_t i = 0; i < b.n; ++i) sortedBulk.insert(make_pair(batch[i], batch[i]));
+        sortedBulk.end_bulk();
+    }
+    b.pc.stop();
+    report("AVLTree sort+bulk", b.pc, b.n);
+
+    // time-series style ingest: keys in increasing order
+    AVLTree<uint64_t, uint64_t> sortedInsert;
+    b.pc.start();
+    for(uint64_t i = 0; i < b.n; ++i) sortedInsert.insert(make_pair(i, i));
+    b.pc.stop();
+    report("AVLTree sorted insert", b.pc, b.n);
+
+    AVLTree<uint64_t, uint64_t> appended;
+    b.pc.start();
+    for(uint64_t i = 0; i < b.n; ++i) appended.append_back(make_pair(i, i));
+    b.pc.stop();
+    report("AVLTree::append_back", b.pc, b.n);
+
+    // priority queue use: read the minimum, then drop it
+    b.pc.start();
+    while(!appended.empty()) {
+        b.sink += appended.front().second;
+        appended.pop_front();
+    }
+    b.pc.stop();
+    report("AVLTree::pop_front", b.pc, b.n);
+}
+
+// Removal: erase while iterating, eager removes and tombstones
+static void benchRemoval(Bench& b, const AVLTree<uint64_t, uint64_t>& avl)
+{
+    // expiry sweep: drop every other key while iterating
+    AVLTree<uint64_t, uint64_t> sweep(avl);
+    b.pc.start();
+    for(AVLTree<uint64_t, uint64_t>::iterator it = sweep.begin(); it != sweep.end(); ) {
+        if(it->first % 2 == 0) it = sweep.erase(it);
+        else ++it;
+    }
+    b.pc.stop();
+    report("AVLTree::erase(iterator)", b.pc, b.n / 2);
+
+    // remove-heavy burst: rebalancing removes versus tombstones
+    AVLTree<uint64_t, uint64_t> eager(avl);
+    b.pc.start();
+    for(uint64_t i = 0; i < b.n / 2; ++i) eager.remove(b.lookups[i]);
+    b.pc.stop();
+    report("AVLTree::remove", b.pc, b.n / 2);
+
+    LazyAVLTree<uint64_t, uint64_t> lazy;
+    fill(lazy, b);
+    b.pc.start();
+    for(uint64_t i = 0; i < b.n / 2; ++i) lazy.remove(b.lookups[i]);
+    b.pc.stop();
+    report("LazyAVLTree::remove", b.pc, b.n / 2);
+}
+
+// Capacity bound: evicting by hand versus the bounded map, which also counts bytes
+static void benchBounded(Bench& b)
+{
+    const uint64_t capacity = b.n / 8;
+    b.pc.start();
+    {
+        AVLTree<uint64_t, uint64_t> capped;
+        for(uint64_t i = 0; i < b.n; ++i) {
+            capped.insert(make_pair(b.keys[i], b.keys[i]));
+            if(capped.size() > capacity) capped.pop_front();
+        }
+        b.sink += capped.size();
+    }
+    b.pc.stop();
+    report("AVLTree insert+pop_front", b.pc, b.n);
+
+    b.pc.start();
+    {
+        BoundedAVLTree<uint64_t, uint64_t> bounded(capacity);
+        fill(bounded, b);
+        b.sink += bounded.size();
+    }
+    b.pc.stop();
+    report("BoundedAVLTree insert", b.pc, b.n);
+}
+
+static void benchSet(Bench& b)
+{
+    AVLSet<uint64_t> keySet;
+    for(uint64_t i = 0; i < b.n; ++i) keySet.insert(b.keys[i]);
+    vector<bool> present;
+    b.pc.start();
+    keySet.contains_many(b.lookups, present);
+    b.pc.stop();
+    for(uint64_t i = 0; i < b.n; ++i) b.sink += present[i];
+    report("AVLSet::contains_many", b.pc, b.n);
+}
+
+static void benchHashed(Bench& b)
+{
+    HashedAVLTree<uint64_t, uint64_t> hashed;
+    b.pc.start();
+    fill(hashed, b);
+    b.pc.stop();
+    report("HashedAVLTree::insert", b.pc, b.n);
+    benchFind(b, hashed, "HashedAVLTree::find");
+}
+
+static void benchCompact(Bench& b)
+{
+    CompactAVLTree<uint64_t, uint64_t> compact;
+    b.pc.start();
+    fill(compact, b);
+    b.pc.stop();
+    report("CompactAVLTree::insert", b.pc, b.n);
+    benchFind(b, compact, "CompactAVLTree::find");
+    benchIteration(b, compact, "CompactAVL iteration");
+}
+
+static void benchIndex(Bench& b)
+{
+    IndexAVLTree<uint64_t, uint64_t> indexed;
+    b.pc.start();
+    fill(indexed, b);
+    b.pc.stop();
+    report("IndexAVLTree::insert", b.pc, b.n);
+    benchFind(b, indexed, "IndexAVLTree::find");
+    benchIteration(b, indexed, "IndexAVL iteration");
+}
+
+// Many tiny per-user maps: node based versus inline
+template<typename Map>
+static void benchTinyMaps(Bench& b, const char* label)
+{
+    const uint64_t tinyKeys = 12;
+    const uint64_t tinyMaps = b.n / tinyKeys;
+    b.pc.start();
+    {
+        vector<Map> maps(tinyMaps);
+        for(uint64_t m = 0; m < tinyMaps; ++m) {
+            for(uint64_t i = 0; i < tinyKeys; ++i) maps[m].insert(make_pair(b.keys[m * tinyKeys + i], i));
+        }
+        for(uint64_t m = 0; m < tinyMaps; ++m) {
+            for(uint64_t i = 0; i < tinyKeys; ++i) b.sink += (maps[m].find(b.lookups[i] % b.n) != maps[m].end());
+        }
+    }
+    b.pc.stop();
+    report(label, b.pc, tinyMaps * tinyKeys);
+}
+
+// Range sums: summing by iteration versus the stored subtree sums
+static void benchAggregate(Bench& b, const AVLTree<uint64_t, uint64_t>& avl)
+{
+    AggregateAVLTree<uint64_t, uint64_t> sums;
+    fill(sums, b);
+    const uint64_t ranges = 1024;
+    b.pc.start();
+    for(uint64_t i = 0; i < ranges; ++i) {
+        uint64_t lo = b.lookups[i % b.n] / 2;
+        for(AVLTree<uint64_t, uint64_t>::iterator it = avl.find(lo); it != avl.end() && it->first <= lo + b.n / 2; ++it) {
+            b.sink += it->second;
+        }
+    }
+    b.pc.stop();
+    report("AVLTree range sum", b.pc, ranges);
+
+    b.pc.start();
+    for(uint64_t i = 0; i < ranges; ++i) {
+        uint64_t lo = b.lookups[i % b.n] / 2;
+        b.sink += sums.aggregate(lo, lo + b.n / 2);
+    }
+    b.pc.stop();
+    report("AggregateAVL::aggregate", b.pc, ranges);
+}
+
+template<typename Tree>
+static void benchLookups(Bench& b, Tree& tree, const vector<uint64_t>& keys, const char* label)
+{
+    b.pc.start();
+    for(uint64_t i = 0; i < keys.size(); ++i) {
+        b.sink += (tree.find(keys[i]) != tree.end());
+    }
+    b.pc.stop();
+    report(label, b.pc, keys.size());
+}
+
+// Skewed lookups: the splay tree moves the hot keys up, the AVL tree does not
+// (and still wins, see splaybst.h)
+static void benchSkewed(Bench& b, const AVLTree<uint64_t, uint64_t>& avl)
+{
+    vector<uint64_t> zipf = zipfKeys(b.n, 4 * b.n, 0.99, b.rng);
+    vector<uint64_t> hotSet = hotSetKeys(b.n, 4 * b.n, b.rng);
+    SplayTree<uint64_t, uint64_t> splay;
+    fill(splay, b);
+
+    benchLookups(b, avl, zipf, "AVLTree::find (Zipf)");
+    benchLookups(b, splay, zipf, "SplayTree::find (Zipf)");
+    benchLookups(b, avl, hotSet, "AVLTree::find (5/90)");
+    benchLookups(b, splay, hotSet, "SplayTree::find (5/90)");
+}
+
+// Mixed read/write ratios on trees prefilled with n keys
+static void benchMixed(Bench& b)
+{
+    const int readPercents[] = { 90, 50, 10 };
+    for(int r = 0; r < 3; ++r) {
+        AVLTree<uint64_t, uint64_t> mixedAvl;
+        RedBlackTree<uint64_t, uint64_t> mixedRb;
+        fill(mixedAvl, b);
+        fill(mixedRb, b);
+
+        string avlLabel = "AVLTree " + to_string(readPercents[r]) + "% reads";
+        b.pc.start();
+        b.sink += mixedWorkload(mixedAvl, b.n, b.n, readPercents[r], b.seed);
+        b.pc.stop();
+        report(avlLabel.c_str(), b.pc, b.n);
+
+        string rbLabel = "RedBlackTree " + to_string(readPercents[r]) + "% reads";
+        b.pc.start();
+        b.sink += mixedWorkload(mixedRb, b.n, b.n, readPercents[r], b.seed);
+        b.pc.stop();
+        report(rbLabel.c_str(), b.pc, b.n);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    Bench b;
+    b.n = (argc > 1) ? strtoull(argv[1], NULL, 10) : 16384;
+    b.seed = (argc > 2) ? static_cast<unsigned>(atoi(argv[2])) : 104;
+    b.sink = 0;
+
+    b.keys.resize(b.n);
+    for(uint64_t i = 0; i < b.n; ++i) b.keys[i] = i;
+    b.rng.seed(b.seed);
+    shuffle(b.keys.begin(), b.keys.end(), b.rng);
+    b.lookups = b.keys;
+    shuffle(b.lookups.begin(), b.lookups.end(), b.rng);
+
+    cout << "keys: " << b.n << endl;
+    header();
+
+    AVLTree<uint64_t, uint64_t> avl;
+    benchBST(b);
+    benchAVL(b, avl);
+    benchSet(b);
+    benchHashed(b);
+    benchAVLBuild(b);
+    benchRemoval(b, avl);
+    benchBounded(b);
+    benchCompact(b);
+    benchIndex(b);
+    benchTinyMaps<AVLTree<uint64_t, uint64_t> >(b, "AVLTree tiny maps");
+    benchTinyMaps<SmallAVLTree<uint64_t, uint64_t> >(b, "SmallAVLTree tiny maps");
+    benchAggregate(b, avl);
+    benchSkewed(b, avl);
+    benchMixed(b);
+
+    // keep the optimizer honest
+    if(b.sink == 0) cout << "(empty)" << endl;
+    return 0;
+}
@@ -1,10 +1,46 @@
 #include <iostream>
 #include <map>
+#include <sstream>
+#include <vector>
+#include <cstdio>
+#include <sys/stat.h>
 #include "bst.h"
 #include "avlbst.h"
+#include "mapped-bst.h"
+#include "avl-journal.h"
+#include "compact-avl.h"
+#include "index-avl.h"
+#include "splaybst.h"
+#include "rbbst.h"
+#include "sgbst.h"
+#include "aggregate-avl.h"
+#include "lazy-avl.h"
+#include "parallel-bst.h"
+#include "small-avl.h"
+#include "hashed-avl.h"
+#include "avl-set.h"
+#include "bounded-avl.h"
 
 using namespace std;
 
+// Lists what a journal fsyncs, noting the log's size at the time
+class SyncOrderJournal : public JournaledAVLTree<int,int>
+{
+public:
+    SyncOrderJournal(const std::string& path) : JournaledAVLTree<int,int>(path), logPath_(path + ".wal") {}
+    std::vector<std::pair<std::string, long> > synced;
+
+protected:
+    virtual void syncFile(int fd, const std::string& path)
+    {
+        JournaledAVLTree<int,int>::syncFile(fd, path);
+        struct stat st;
+        synced.push_back(std::make_pair(path, stat(logPath_.c_str(), &st) == 0 ? (long)st.st_size : -1L));
+    }
+
+    std::string logPath_;
+};
+
 
 int main(int argc, char *argv[])
 {
@@ -26,6 +62,16 @@ int main(int argc, char *argv[])
     cout << "Erasing b" << endl;
     bt.remove('b');
 
+    // Sorted inserts make a chain; rebalance() fixes it in place
+    BinarySearchTree<int,int> chain;
+    for(int i = 1; i <= 7; ++i) {
+        chain.insert(std::make_pair(i, i));
+    }
+    cout << "Chain balanced: " << chain.isBalanced();
+    chain.rebalance();
+    cout << ", after rebalance(): " << chain.isBalanced() << endl;
+    chain.print();
+
     // AVL Tree Tests
     AVLTree<char,int> at;
     at.insert(std::make_pair('a',1));
@@ -44,5 +90,318 @@ int main(int argc, char *argv[])
     cout << "Erasing b" << endl;
     at.remove('b');
 
-    return 0;
+    // Nearly sorted stream: append at the end, patch a late key with a hint
+    AVLTree<int,int> series;
+    for(int i = 0; i < 20; i += 2) {
+        series.append_back(std::make_pair(i, i));
+    }
+    AVLTree<int,int>::iterator hint = series.find(14);
+    hint = series.insert(hint, std::make_pair(13, 13));
+    cout << "\nHinted insert returned " << hint->first
+         << ", balanced: " << series.isBalanced() << endl;
+    series.pop_front();
+    series.pop_back();
+    cout << "After pop_front/pop_back: front " << series.front().first
+         << ", back " << series.back().first << endl;
+
+    // Erase by iterator: drop the odd keys, then everything from 12 on
+    for(AVLTree<int,int>::iterator it = series.begin(); it != series.end(); ) {
+        if(it->first % 2 == 1) it = series.erase(it);
+        else ++it;
+    }
+    series.erase(series.find(12), series.end());
+    cout << "After erase:";
+    for(AVLTree<int,int>::iterator it = series.begin(); it != series.end(); ++it) {
+        cout << " " << it->first;
+    }
+    cout << endl;
+
+    // Bulk load: no rebalancing until end_bulk()
+    AVLTree<int,int> bulk;
+    bulk.begin_bulk();
+    for(int i = 0; i < 15; ++i) {
+        bulk.insert(std::make_pair(i, i));
+    }
+    cout << "Bulk loaded, balanced: " << bulk.isBalanced();
+    bulk.end_bulk();
+    cout << ", after end_bulk(): " << bulk.isBalanced() << endl;
+
+    // Shape statistics in one pass
+    TreeShape shape = bulk.analyze();
+    cout << "Bulk tree: " << shape.size << " nodes, height " << shape.height
+         << ", average search depth " << shape.averageSearchDepth
+         << ", AVL violations " << shape.avlViolations << ", nodes per level:";
+    for(size_t d = 0; d < shape.nodesAtLevel.size(); ++d) {
+        cout << " " << shape.nodesAtLevel[d];
+    }
+    cout << endl;
+    MemoryUsage memory = bulk.memory_usage();
+    cout << "Bulk tree memory: " << memory.nodes << " nodes, " << memory.payloadBytes << " bytes payload, "
+         << memory.overheadBytes << " bytes overhead, " << memory.estimatedSlackBytes << " bytes allocator slack (estimated)" << endl;
+
+    // Lazy deletion: removals leave tombstones until a compaction
+    LazyAVLTree<int,int> lazy;
+    for(int i = 0; i < 8; ++i) {
+        lazy.insert(std::make_pair(i, i));
+    }
+    lazy.remove(3);
+    cout << "LazyAVLTree size " << lazy.size() << ", tombstones " << lazy.tombstones();
+    for(int i = 4; i < 8; ++i) {
+        lazy.remove(i);
+    }
+    cout << "; after more removes: size " << lazy.size() << ", tombstones " << lazy.tombstones() << endl;
+
+    // Batched lookups
+    std::vector<int> wanted;
+    wanted.push_back(4);
+    wanted.push_back(5);
+    wanted.push_back(13);
+    std::vector<AVLTree<int,int>::iterator> results;
+    series.find_many(wanted, results);
+    for(size_t i = 0; i < wanted.size(); ++i) {
+        cout << "find_many " << wanted[i] << ": "
+             << (results[i] != series.end() ? "found" : "missing") << endl;
+    }
+
+    // Range sums kept in the nodes
+    AggregateAVLTree<int,int> sums;
+    for(int i = 1; i <= 10; ++i) {
+        sums.insert(std::make_pair(i, i));
+    }
+    sums.remove(5);
+    cout << "Sum of 3..7: " << sums.aggregate(3, 7) << endl;
+
+    // Copies are independent; moves and swaps just hand the nodes over
+    AggregateAVLTree<int,int> sumsCopy(sums);
+    sumsCopy.remove(3);
+    AggregateAVLTree<int,int> moved(std::move(sumsCopy));
+    moved.swap(sums);
+    cout << "After copy, move and swap: " << moved.aggregate(3, 7)
+         << " and " << sums.aggregate(3, 7) << ", moved-from empty: " << sumsCopy.empty() << endl;
+
+    // Parallel traversals: square the values, then sum them
+    AVLTree<int,int> squares;
+    for(int i = 1; i <= 100; ++i) {
+        squares.insert(std::make_pair(i, i));
+    }
+    parallel_transform_values(squares, [](const int&, const int& v) { return v * v; }, 4);
+    int total = parallel_reduce(squares, 0, [](const std::pair<const int,int>& item) { return item.second; },
+                                [](int a, int b) { return a + b; }, 4);
+    std::string digits = parallel_reduce_ordered(squares, std::string(),
+        [](const std::pair<const int,int>& item) { return std::string(1, char('0' + item.first % 10)); },
+        [](const std::string& a, const std::string& b) { return a + b; }, 4);
+    cout << "Sum of squares 1..100: " << total << ", last digits in order: " << digits.substr(0, 12) << endl;
+
+    // Small maps stay inline until they outgrow N items
+    SmallAVLTree<int,int,4> small;
+    for(int i = 4; i >= 1; --i) {
+        small.insert(std::make_pair(i, i * 10));
+    }
+    cout << "SmallAVLTree of " << small.size() << " inline: " << small.isInline();
+    small.insert(std::make_pair(5, 50));
+    cout << ", of " << small.size() << " inline: " << small.isInline();
+    small.remove(1);
+    small.remove(2);
+    small.remove(3);
+    cout << ", of " << small.size() << " inline: " << small.isInline() << ", contents:";
+    for(SmallAVLTree<int,int,4>::iterator it = small.begin(); it != small.end(); ++it) {
+        cout << " " << it->first << "=" << it->second;
+    }
+    cout << endl;
+
+    // Hash indexed point lookups, ordered iteration
+    HashedAVLTree<int,int> hashed;
+    for(int i = 10; i >= 1; --i) {
+        hashed.insert(std::make_pair(i, i * i));
+    }
+    hashed.remove(4);
+    hashed.pop_front();
+    cout << "HashedAVLTree [7] = " << hashed[7] << ", has 4: " << (hashed.find(4) != hashed.end())
+         << ", first: " << hashed.begin()->first << ", balanced: " << hashed.isBalanced() << endl;
+
+    // Key-only sets
+    AVLSet<int> odds;
+    for(int i = 1; i < 20; i += 2) {
+        odds.insert(i);
+    }
+    odds.remove(9);
+    std::vector<bool> inOdds;
+    odds.contains_many(wanted, inOdds);
+    cout << "AVLSet:";
+    for(AVLSet<int>::iterator it = odds.begin(); it != odds.end(); ++it) {
+        cout << " " << *it;
+    }
+    cout << "; contains 4, 5, 13: " << inOdds[0] << inOdds[1] << inOdds[2]
+         << "; balanced: " << odds.isBalanced() << endl;
+
+    // Copies, assignments and swaps carry the balances along, so later
+    // updates still keep the sets balanced
+    AVLSet<int> oddsCopy(odds);
+    AVLSet<int> evens;
+    for(int i = 0; i < 64; i += 2) {
+        evens.insert(i);
+    }
+    AVLSet<int> assigned;
+    assigned = evens;
+    assigned.swap(oddsCopy);
+    for(int i = 64; i < 96; ++i) {
+        oddsCopy.insert(i);
+        assigned.insert(i * 2 + 1);
+    }
+    for(int i = 0; i < 64; i += 4) {
+        oddsCopy.remove(i);
+    }
+    bool setCopiesOk = odds.size() == 9 && odds.isBalanced()
+        && oddsCopy.size() == 48 && oddsCopy.isBalanced()
+        && assigned.size() == 41 && assigned.isBalanced()
+        && evens.size() == 32 && evens.isBalanced();
+    cout << "AVLSet copy, assign, swap then update: sizes " << oddsCopy.size() << " " << assigned.size()
+         << "; ok: " << setCopiesOk << endl;
+
+    // Bounded map keyed by expiry time: the earliest expiries are evicted
+    BoundedAVLTree<int,int> expiring(8);
+    for(int i = 1; i <= 12; ++i) {
+        expiring.insert(std::make_pair(i * 10, i));
+    }
+    size_t expired = expiring.expire(70);
+    cout << "BoundedAVLTree:";
+    for(BoundedAVLTree<int,int>::iterator it = expiring.begin(); it != expiring.end(); ++it) {
+        cout << " " << it->first;
+    }
+    cout << "; evicted " << expiring.evictions() << ", expired " << expired
+         << ", bytes " << expiring.bytes() << ", balanced: " << expiring.isBalanced() << endl;
+
+    // An item inserted in bulk mode and overwritten afterwards is measured again
+    BoundedAVLTree<int,std::string> sized(0, 1 << 20, [](const int&, const std::string& s) { return s.size(); });
+    sized.begin_bulk();
+    sized.insert(std::make_pair(1, std::string("a")));
+    sized.end_bulk();
+    size_t bulkBytes = sized.bytes();
+    sized.insert(std::make_pair(1, std::string(1000, 'x')));
+    bool overwriteOk = sized.bytes() == bulkBytes + 999;
+    cout << "BoundedAVLTree bytes after bulk insert " << bulkBytes << ", after overwrite " << sized.bytes()
+         << "; ok: " << overwriteOk << endl;
+
+    // Snapshot round trip
+    AVLTree<int,int> snap;
+    for(int i = 0; i < 10; ++i) {
+        snap.insert(std::make_pair(i, i * i));
+    }
+    std::stringstream buffer;
+    snap.save(buffer);
+    AVLTree<int,int> reloaded;
+    reloaded.load(buffer);
+
+    cout << "\nReloaded AVLTree contents:" << endl;
+    for(AVLTree<int,int>::iterator it = reloaded.begin(); it != reloaded.end(); ++it) {
+        cout << it->first << " " << it->second << endl;
+    }
+    cout << "Balanced: " << reloaded.isBalanced() << endl;
+
+    // Memory mapped export
+    writeMappedTree(reloaded, "bst-test.map");
+    {
+        MappedTree<int,int> mapped("bst-test.map");
+        cout << "\nMapped tree contents:" << endl;
+        for(MappedTree<int,int>::iterator it = mapped.begin(); it != mapped.end(); ++it) {
+            cout << it->first << " " << it->second << endl;
+        }
+        cout << "mapped[7] = " << mapped[7] << endl;
+        cout << "lower_bound(-1) = " << mapped.lower_bound(-1)->first << endl;
+    }
+    std::remove("bst-test.map");
+
+    // Journaled updates survive reopening
+    {
+        JournaledAVLTree<int,int> journal("bst-test.db");
+        journal.insert(std::make_pair(1, 10));
+        journal.insert(std::make_pair(2, 20));
+        journal.remove(1);
+    }
+    {
+        JournaledAVLTree<int,int> journal("bst-test.db");
+        cout << "\nJournal replayed " << journal.replayed() << " updates:" << endl;
+        for(JournaledAVLTree<int,int>::iterator it = journal.begin(); it != journal.end(); ++it) {
+            cout << it->first << " " << it->second << endl;
+        }
+    }
+    // A checkpoint must make the snapshot's rename durable (sync the
+    // directory) while the log still holds the updates, then empty the log
+    bool syncOrderOk = false;
+    {
+        SyncOrderJournal journal("bst-test.db");
+        journal.insert(std::make_pair(3, 30));
+        journal.checkpoint();
+        const std::vector<std::pair<std::string, long> >& synced = journal.synced;
+        size_t n = synced.size();
+        syncOrderOk = n >= 4 &&
+            synced[n - 4].first == "bst-test.db.wal" &&
+            synced[n - 3].first == "bst-test.db.snap.tmp" &&
+            synced[n - 2].first == "." && synced[n - 2].second > 0 &&
+            synced[n - 1].first == "bst-test.db.wal" && synced[n - 1].second == 0;
+        cout << "Checkpoint synced:";
+        for(size_t i = 0; i < n; ++i) {
+            cout << " " << synced[i].first << " (log " << synced[i].second << " bytes)";
+        }
+        cout << "; order ok: " << syncOrderOk << endl;
+    }
+    std::remove("bst-test.db.snap");
+    std::remove("bst-test.db.wal");
+
+    // Compact (parent-free) AVL tree
+    CompactAVLTree<char,int> ct;
+    ct.insert(std::make_pair('c',3));
+    ct.insert(std::make_pair('a',1));
+    ct.insert(std::make_pair('b',2));
+    ct.remove('c');
+    cout << "\nCompactAVLTree contents:" << endl;
+    for(CompactAVLTree<char,int>::iterator it = ct.begin(); it != ct.end(); ++it) {
+        cout << it->first << " " << it->second << endl;
+    }
+    cout << "Balanced: " << ct.isBalanced() << endl;
+
+    // Index based AVL tree, copied as plain vectors
+    IndexAVLTree<char,int> it32;
+    it32.insert(std::make_pair('z',26));
+    it32.insert(std::make_pair('x',24));
+    it32.insert(std::make_pair('y',25));
+    IndexAVLTree<char,int> copy32(it32);
+    copy32.remove('x');
+    cout << "\nIndexAVLTree contents:" << endl;
+    for(IndexAVLTree<char,int>::iterator it = copy32.begin(); it != copy32.end(); ++it) {
+        cout << it->first << " " << it->second << endl;
+    }
+    cout << "Original size: " << it32.size() << ", copy size: " << copy32.size() << endl;
+
+    // Splay tree: accessed keys move to the root
+    SplayTree<int,int> st;
+    for(int i = 1; i <= 7; ++i) {
+        st.insert(std::make_pair(i, i * 10));
+    }
+    st.find(4);
+    st.remove(7);
+    cout << "\nSplayTree after find(4) and remove(7):" << endl;
+    st.print();
+
+    // Red-black tree
+    RedBlackTree<int,int> rb;
+    for(int i = 1; i <= 10; ++i) {
+        rb.insert(std::make_pair(i, i));
+    }
+    rb.remove(4);
+    cout << "\nRedBlackTree valid: " << rb.isValidRedBlack() << endl;
+    for(RedBlackTree<int,int>::iterator it = rb.begin(); it != rb.end(); ++it) {
+        cout << it->first << " ";
+    }
+    cout << endl;
+
+    // Scapegoat tree stays shallow on sorted input
+    ScapegoatTree<int,int> sg;
+    for(int i = 1; i <= 1000; ++i) {
+        sg.insert(std::make_pair(i, i));
+    }
+    sg.remove(500);
+    cout << "\nScapegoatTree size: " << sg.size() << ", found 999: " << (sg.find(999) != sg.end()) << endl;
+
+    return syncOrderOk && overwriteOk && setCopiesOk ? 0 : 1;
 }
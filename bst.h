@@ -4,7 +4,23 @@
 #include <iostream>
 #include <exception>
 #include <cstdlib>
+#include <cstdint>
 #include <utility>
+#include <vector>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+/**
+ * The item a Node holds and iterators yield: the key and value as a
+ * std::pair. A specialization can swap in another type with members first
+ * and second and a (key, value) constructor (see SetItem in avl-set.h).
+ */
+template <typename Key, typename Value>
+struct NodeItem
+{
+    typedef std::pair<const Key, Value> type;
+};
 
 /**
  * A templated class for a Node in a search tree.
@@ -17,11 +33,13 @@ template <typename Key, typename Value>
 class Node
 {
 public:
+    typedef typename NodeItem<Key, Value>::type Item;
+
     Node(const Key& key, const Value& value, Node<Key, Value>* parent);
     virtual ~Node();
 
-    const std::pair<const Key, Value>& getItem() const;
-    std::pair<const Key, Value>& getItem();
+    const Item& getItem() const;
+    Item& getItem();
     const Key& getKey() const;
     const Value& getValue() const;
     Value& getValue();
@@ -35,11 +53,17 @@ public:
     void setRight(Node<Key, Value>* right);
     void setValue(const Value &value);
 
+    // A childless copy of this node (including any subclass data) under parent
+    virtual Node<Key, Value>* clone(Node<Key, Value>* parent) const;
+    // Bytes of the node object itself, including any subclass data
+    virtual size_t footprint() const;
+
 protected:
-    std::pair<const Key, Value> item_;
     Node<Key, Value>* parent_;
     Node<Key, Value>* left_;
     Node<Key, Value>* right_;
+    // Last, so that a subclass member can use the padding after a small item
+    Item item_;
 };
 
 /*
@@ -53,10 +77,10 @@ protected:
 */
 template<typename Key, typename Value>
 Node<Key, Value>::Node(const Key& key, const Value& value, Node<Key, Value>* parent) :
-    item_(key, value),
     parent_(parent),
     left_(NULL),
-    right_(NULL)
+    right_(NULL),
+    item_(key, value)
 {
 
 }
@@ -76,7 +100,7 @@ Node<Key, Value>::~Node()
 * A const getter for the item.
 */
 template<typename Key, typename Value>
-const std::pair<const Key, Value>& Node<Key, Value>::getItem() const
+const typename Node<Key, Value>::Item& Node<Key, Value>::getItem() const
 {
     return item_;
 }
@@ -85,7 +109,7 @@ const std::pair<const Key, Value>& Node<Key, Value>::getItem() const
 * A non-const getter for the item.
 */
 template<typename Key, typename Value>
-std::pair<const Key, Value>& Node<Key, Value>::getItem()
+typename Node<Key, Value>::Item& Node<Key, Value>::getItem()
 {
     return item_;
 }
@@ -180,12 +204,74 @@ void Node<Key, Value>::setValue(const Value& value)
     item_.second = value;
 }
 
+/**
+* Copies the item into a new node; subclasses override this to copy their
+* own data members as well.
+*/
+template<typename Key, typename Value>
+Node<Key, Value>* Node<Key, Value>::clone(Node<Key, Value>* parent) const
+{
+    return new Node<Key, Value>(item_.first, item_.second, parent);
+}
+
+template<typename Key, typename Value>
+size_t Node<Key, Value>::footprint() const
+{
+    return sizeof(*this);
+}
+
 /*
   ---------------------------------------
   End implementations for the Node class.
   ---------------------------------------
 */
 
+/**
+* Shape statistics from BinarySearchTree::analyze(). Levels and depths count
+* from 0 at the root; height counts levels, so an empty tree has height 0.
+* The fill of level d is nodesAtLevel[d] / 2^d.
+*
+* A sampled analysis estimates the counts from random root-to-leaf probes
+* (Knuth's estimator, which is unbiased), reports the deepest probe as the
+* height, and does not look for AVL violations.
+*/
+struct TreeShape
+{
+    TreeShape() : sampled(false), size(0), height(0), averageSearchDepth(0.0), avlViolations(0) {}
+
+    bool sampled;
+    size_t size;
+    int height;
+    std::vector<size_t> nodesAtLevel;
+    std::vector<size_t> leavesAtDepth;
+    double averageSearchDepth;      // nodes a successful find() visits, on average
+    size_t avlViolations;           // nodes whose subtree heights differ by more than 1
+};
+
+/**
+* Memory held by a tree, from BinarySearchTree::memory_usage(). The payload
+* is sizeof(Key) + sizeof(Value) per node; the overhead is the rest of the
+* node object (links, vtable pointer, balance or color, padding). The
+* slack is an estimate of what the allocator adds on top of each node for
+* its header and size rounding: the root's slack times the node count.
+* Every node of a tree has the same size, so with glibc, which rounds each
+* size the same way, it is exact; elsewhere the root's slack is itself a
+* guess at a one word header and 16 byte rounding. heapBytes is only
+* filled in by the overload with a callback.
+*/
+struct MemoryUsage
+{
+    MemoryUsage() : nodes(0), nodeBytes(0), payloadBytes(0), overheadBytes(0), estimatedSlackBytes(0), heapBytes(0) {}
+    size_t total() const { return nodeBytes + estimatedSlackBytes + heapBytes; }
+
+    size_t nodes;
+    size_t nodeBytes;
+    size_t payloadBytes;
+    size_t overheadBytes;
+    size_t estimatedSlackBytes;
+    size_t heapBytes;
+};
+
 /**
 * A templated unbalanced binary search tree.
 */
@@ -194,17 +280,39 @@ class BinarySearchTree
 {
 public:
     BinarySearchTree(); //TODO
+    BinarySearchTree(const BinarySearchTree& other);
+    BinarySearchTree(BinarySearchTree&& other);
     virtual ~BinarySearchTree(); //TODO
+    BinarySearchTree& operator=(const BinarySearchTree& other);
+    BinarySearchTree& operator=(BinarySearchTree&& other);
+    // other must be the same kind of tree as this one
+    void swap(BinarySearchTree& other);
     virtual void insert(const std::pair<const Key, Value>& keyValuePair); //TODO
     virtual void remove(const Key& key); //TODO
-    void clear(); //TODO
+    virtual void clear(); //TODO
     bool isBalanced() const; //TODO
+    // One iterative pass over the whole tree, or with probes > 0 an estimate
+    // from that many random descents
+    TreeShape analyze(size_t probes = 0, unsigned seed = 1) const;
+    // O(1) from the node count kept by every insert and removal; the
+    // allocator slack is extrapolated from the root
+    MemoryUsage memory_usage() const;
+    // Also adds heapBytes(key, value) for every item, which takes a full walk
+    template<class HeapBytes>
+    MemoryUsage memory_usage(HeapBytes heapBytes) const;
+    // Virtual so that balanced subclasses can restore their own invariants
+    virtual void rebalance();
     void print() const;
     bool empty() const;
+    size_t size() const;
 
     template<typename PPKey, typename PPValue>
     friend void prettyPrintBST(BinarySearchTree<PPKey, PPValue> & tree);
+    template<typename PKey, typename PValue>
+    friend class ParallelTreeWalker;
 public:
+    typedef typename Node<Key, Value>::Item Item;
+
     /**
     * An internal iterator class for traversing the contents of the BST.
     */
@@ -213,8 +321,8 @@ public:
     public:
         iterator();
 
-        std::pair<const Key,Value>& operator*() const;
-        std::pair<const Key,Value>* operator->() const;
+        Item& operator*() const;
+        Item* operator->() const;
 
         bool operator==(const iterator& rhs) const;
         bool operator!=(const iterator& rhs) const;
@@ -231,8 +339,17 @@ public:
     iterator begin() const;
     iterator end() const;
     iterator find(const Key& key) const;
+    void find_many(const std::vector<Key>& keys, std::vector<iterator>& out) const;
     Value& operator[](const Key& key);
     Value const & operator[](const Key& key) const;
+    Item& front() const;
+    Item& back() const;
+    void pop_front();
+    void pop_back();
+    // Remove the item(s) at an iterator without searching for the key;
+    // return an iterator to the item after the last one removed
+    iterator erase(iterator pos);
+    iterator erase(iterator first, iterator last);
 
 protected:
     // Mandatory helper functions
@@ -245,16 +362,40 @@ protected:
     // Provided helper functions
     virtual void printRoot (Node<Key, Value> *r) const;
     virtual void nodeSwap( Node<Key,Value>* n1, Node<Key,Value>* n2) ;
+    // Unlinks and deletes node; subclasses override this to rebalance. A
+    // node with two children hands its place to its successor if
+    // bySuccessor is set, else to its predecessor
+    virtual void removeNode(Node<Key, Value>* node, bool bySuccessor);
+    Node<Key, Value>* spliceOut(Node<Key, Value>* node, Node<Key, Value>* heir, bool& fromLeft);
 
     // Add helper functions here
     static Node<Key, Value>* successor(Node<Key, Value>* current);   // NEW helper
+    Node<Key, Value>* getLargestNode() const;
+    static Node<Key, Value>* nodeOf(const iterator& it);
+    static iterator iteratorAt(Node<Key, Value>* node);
     void clearHelper(Node<Key, Value>* root);                        // NEW helper
     int heightOrNegOne(Node<Key, Value>* root) const;                // NEW helper
+    TreeShape sampleShape(size_t probes, unsigned seed) const;
+    static size_t allocationSlack(const Node<Key, Value>* node);
+    Node<Key, Value>* rebalanceSubtree(Node<Key, Value>* root);
+    void rotateLeftAt(Node<Key, Value>* x);
+    void rotateRightAt(Node<Key, Value>* x);
+    size_t treeToVine(Node<Key, Value>* root);
+    void compressVine(Node<Key, Value>* top, size_t count);
+    void trackInsert(Node<Key, Value>* node);
+    void trackRemove(Node<Key, Value>* node);
+    void resetEnds();
+    static Node<Key, Value>* cloneTree(const Node<Key, Value>* root);
 
 
 protected:
     Node<Key, Value>* root_;
     // You should not need other data members
+    // Cached smallest and largest nodes; rotations never change them
+    Node<Key, Value>* leftmost_;
+    Node<Key, Value>* rightmost_;
+    // Nodes linked into the tree, kept by trackInsert()/trackRemove()
+    size_t count_;
 };
 
 /*
@@ -288,7 +429,7 @@ BinarySearchTree<Key, Value>::iterator::iterator()
 * Provides access to the item.
 */
 template<class Key, class Value>
-std::pair<const Key,Value> &
+typename BinarySearchTree<Key, Value>::Item &
 BinarySearchTree<Key, Value>::iterator::operator*() const
 {
     return current_->getItem();
@@ -298,7 +439,7 @@ BinarySearchTree<Key, Value>::iterator::operator*() const
 * Provides access to the address of the item.
 */
 template<class Key, class Value>
-std::pair<const Key,Value> *
+typename BinarySearchTree<Key, Value>::Item *
 BinarySearchTree<Key, Value>::iterator::operator->() const
 {
     return &(current_->getItem());
@@ -369,6 +510,72 @@ BinarySearchTree<Key, Value>::BinarySearchTree()
 {
     // TODO
     root_ = NULL;
+    leftmost_ = NULL;
+    rightmost_ = NULL;
+    count_ = 0;
+}
+
+/**
+* Copy constructor. The copy has exactly the same shape as other, so it is
+* built in O(n) without comparing keys or rebalancing.
+*/
+template<class Key, class Value>
+BinarySearchTree<Key, Value>::BinarySearchTree(const BinarySearchTree& other)
+{
+    root_ = cloneTree(other.root_);
+    resetEnds();
+    count_ = other.count_;
+}
+
+/**
+* Move constructor: takes over other's nodes and leaves it empty.
+*/
+template<class Key, class Value>
+BinarySearchTree<Key, Value>::BinarySearchTree(BinarySearchTree&& other)
+{
+    root_ = other.root_;
+    leftmost_ = other.leftmost_;
+    rightmost_ = other.rightmost_;
+    count_ = other.count_;
+    other.root_ = NULL;
+    other.leftmost_ = NULL;
+    other.rightmost_ = NULL;
+    other.count_ = 0;
+}
+
+template<class Key, class Value>
+BinarySearchTree<Key, Value>&
+BinarySearchTree<Key, Value>::operator=(const BinarySearchTree& other)
+{
+    if(this != &other) {
+        // build the copy first so a failed allocation leaves this unchanged
+        BinarySearchTree<Key, Value> copy(other);
+        swap(copy);
+    }
+    return *this;
+}
+
+template<class Key, class Value>
+BinarySearchTree<Key, Value>&
+BinarySearchTree<Key, Value>::operator=(BinarySearchTree&& other)
+{
+    if(this != &other) {
+        clear();
+        swap(other);
+    }
+    return *this;
+}
+
+/**
+* Exchanges the contents of two trees in O(1).
+*/
+template<class Key, class Value>
+void BinarySearchTree<Key, Value>::swap(BinarySearchTree& other)
+{
+    std::swap(root_, other.root_);
+    std::swap(leftmost_, other.leftmost_);
+    std::swap(rightmost_, other.rightmost_);
+    std::swap(count_, other.count_);
 }
 
 template<typename Key, typename Value>
@@ -388,6 +595,15 @@ bool BinarySearchTree<Key, Value>::empty() const
     return root_ == NULL;
 }
 
+/**
+* Returns the number of items in O(1)
+*/
+template<class Key, class Value>
+size_t BinarySearchTree<Key, Value>::size() const
+{
+    return count_;
+}
+
 template<typename Key, typename Value>
 void BinarySearchTree<Key, Value>::print() const
 {
@@ -430,6 +646,150 @@ BinarySearchTree<Key, Value>::find(const Key & k) const
     return it;
 }
 
+/**
+* Looks up every key in keys and stores an iterator to it (or end()) at the
+* same index in out. FIND_MANY_GROUP lookups walk down the tree in lockstep:
+* each one takes a single step per round and prefetches the node it moves
+* to, so the cache misses of the group overlap instead of stalling one at a
+* time.
+*/
+template<class Key, class Value>
+void BinarySearchTree<Key, Value>::find_many(const std::vector<Key>& keys,
+                                             std::vector<iterator>& out) const
+{
+    static const size_t FIND_MANY_GROUP = 8;
+    out.assign(keys.size(), end());
+    if(root_ == NULL) return;
+
+    Node<Key, Value>* curr[FIND_MANY_GROUP];
+    size_t which[FIND_MANY_GROUP];
+    size_t active = 0;
+    size_t next = 0;
+    while(active < FIND_MANY_GROUP && next < keys.size()) {
+        curr[active] = root_;
+        which[active++] = next++;
+    }
+
+    while(active > 0) {
+        for(size_t i = 0; i < active; ) {
+            Node<Key, Value>* node = curr[i];
+            const Key& key = keys[which[i]];
+            if(key < node->getKey()) {
+                node = node->getLeft();
+            }
+            else if(key > node->getKey()) {
+                node = node->getRight();
+            }
+            else {
+                out[which[i]] = iterator(node);
+                node = NULL;
+            }
+
+            if(node != NULL) {
+#if defined(__GNUC__)
+                __builtin_prefetch(node);
+#endif
+                curr[i++] = node;
+            }
+            else if(next < keys.size()) {
+                // this lookup is done: start the next key in its slot
+                curr[i] = root_;
+                which[i++] = next++;
+            }
+            else {
+                --active;
+                curr[i] = curr[active];
+                which[i] = which[active];
+            }
+        }
+    }
+}
+
+/**
+ * @precondition The tree is not empty
+ * Returns the smallest item in O(1)
+ */
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::Item& BinarySearchTree<Key, Value>::front() const
+{
+    if(leftmost_ == NULL) throw std::out_of_range("Empty tree");
+    return leftmost_->getItem();
+}
+
+/**
+ * @precondition The tree is not empty
+ * Returns the largest item in O(1)
+ */
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::Item& BinarySearchTree<Key, Value>::back() const
+{
+    if(rightmost_ == NULL) throw std::out_of_range("Empty tree");
+    return rightmost_->getItem();
+}
+
+/**
+ * Removes the smallest item, if any. This goes through the (virtual)
+ * removeNode() so subclasses keep their balance.
+ */
+template<class Key, class Value>
+void BinarySearchTree<Key, Value>::pop_front()
+{
+    if(leftmost_ == NULL) return;
+    removeNode(leftmost_, false);
+}
+
+/**
+ * Removes the largest item, if any.
+ */
+template<class Key, class Value>
+void BinarySearchTree<Key, Value>::pop_back()
+{
+    if(rightmost_ == NULL) return;
+    removeNode(rightmost_, false);
+}
+
+/**
+ * Removes the item at pos, which must be a valid iterator into this tree.
+ * Removal relinks nodes rather than moving items, so every other iterator,
+ * including the returned successor, stays valid. A node with two children
+ * is replaced by that successor, which is already at hand.
+ */
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::iterator
+BinarySearchTree<Key, Value>::erase(iterator pos)
+{
+    Node<Key, Value>* node = pos.current_;
+    if(node == NULL) return end();
+    iterator next(successor(node));
+    removeNode(node, true);
+    return next;
+}
+
+/**
+ * Removes the items in [first, last). Erasing everything frees the nodes
+ * in one pass without any rebalancing. Otherwise each node hands its place
+ * to its predecessor, which lies before first: the successor would take the
+ * place instead and be the next to go, so every erase would again start
+ * high up and reach down for a new heir. This way the next node to go has
+ * no left child and comes out near the leaves, which makes a long range
+ * about twice as fast.
+ */
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::iterator
+BinarySearchTree<Key, Value>::erase(iterator first, iterator last)
+{
+    if(first.current_ == leftmost_ && last.current_ == NULL) {
+        clear();
+        return end();
+    }
+    while(first != last) {
+        Node<Key, Value>* node = first.current_;
+        ++first;
+        removeNode(node, false);
+    }
+    return last;
+}
+
 /**
  * @precondition The key exists in the map
  * Returns the value associated with the key
@@ -466,6 +826,7 @@ void BinarySearchTree<Key, Value>::insert(const std::pair<const Key, Value> &key
     if(root_ == NULL)
     {
         root_ = new Node<Key, Value>(key, value, NULL);
+        trackInsert(root_);
         return;
     }
 
@@ -478,6 +839,7 @@ void BinarySearchTree<Key, Value>::insert(const std::pair<const Key, Value> &key
             {
                 Node<Key, Value>* node = new Node<Key, Value>(key, value, curr);
                 curr->setLeft(node);
+                trackInsert(node);
                 break;
             }
             else
@@ -491,6 +853,7 @@ void BinarySearchTree<Key, Value>::insert(const std::pair<const Key, Value> &key
             {
                 Node<Key, Value>* node = new Node<Key, Value>(key, value, curr);
                 curr->setRight(node);
+                trackInsert(node);
                 break;
             }
             else
@@ -519,38 +882,77 @@ void BinarySearchTree<Key, Value>::remove(const Key& key)
     // TODO
     Node<Key, Value>* node = internalFind(key);
     if(node == NULL) return;
+    removeNode(node, false);
+}
 
-    // If node has two children, swap with its predecessor first
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::removeNode(Node<Key, Value>* node, bool bySuccessor)
+{
+    // If node has two children, its predecessor (or successor) takes its place
+    Node<Key, Value>* heir = NULL;
     if(node->getLeft() != NULL && node->getRight() != NULL)
     {
-        Node<Key, Value>* pred = predecessor(node);
-        nodeSwap(node, pred);
+        heir = bySuccessor ? successor(node) : predecessor(node);
     }
 
-    // Now node has at most one child
-    Node<Key, Value>* parent = node->getParent();
-    Node<Key, Value>* child = (node->getLeft() != NULL) ? node->getLeft() : node->getRight();
-
-    if(child != NULL)
-    {
-        child->setParent(parent);
-    }
+    trackRemove(node);
+    bool fromLeft;
+    spliceOut(node, heir, fromLeft);
+    delete node;
+}
 
-    if(parent == NULL)
-    {
-        // Removing the root
-        root_ = child;
+/**
+* Unlinks node without freeing it. With heir NULL, node must have at most
+* one child, which moves up into its place. Otherwise heir is node's
+* predecessor or successor: it leaves its own spot to its only child and
+* then takes node's place and children, so no items move. Returns the
+* lowest node whose subtree lost a level (NULL if that was the whole tree)
+* and sets fromLeft to the side it lost it on.
+*/
+template<typename Key, typename Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::spliceOut(Node<Key, Value>* node,
+                                                          Node<Key, Value>* heir, bool& fromLeft)
+{
+    Node<Key, Value>* parent = node->getParent();
+    Node<Key, Value>* shrunk;
+    if(heir == NULL) {
+        heir = (node->getLeft() != NULL) ? node->getLeft() : node->getRight();
+        shrunk = parent;
+        fromLeft = (parent != NULL && parent->getLeft() == node);
     }
-    else if(parent->getLeft() == node)
-    {
-        parent->setLeft(child);
+    else if(heir == node->getLeft() || heir == node->getRight()) {
+        // a child of node keeps its outer subtree and adopts the other one
+        fromLeft = (heir == node->getLeft());
+        if(fromLeft) {
+            heir->setRight(node->getRight());
+            heir->getRight()->setParent(heir);
+        }
+        else {
+            heir->setLeft(node->getLeft());
+            heir->getLeft()->setParent(heir);
+        }
+        shrunk = heir;
     }
-    else if(parent->getRight() == node)
-    {
-        parent->setRight(child);
+    else {
+        // deeper down, a successor is always a left child and a predecessor
+        // a right one; its only child takes its spot
+        shrunk = heir->getParent();
+        fromLeft = (shrunk->getLeft() == heir);
+        Node<Key, Value>* child = fromLeft ? heir->getRight() : heir->getLeft();
+        if(fromLeft) shrunk->setLeft(child);
+        else shrunk->setRight(child);
+        if(child != NULL) child->setParent(shrunk);
+        heir->setLeft(node->getLeft());
+        heir->getLeft()->setParent(heir);
+        heir->setRight(node->getRight());
+        heir->getRight()->setParent(heir);
     }
 
-    delete node;
+    if(heir != NULL) heir->setParent(parent);
+    if(parent == NULL) root_ = heir;
+    else if(parent->getLeft() == node) parent->setLeft(heir);
+    else parent->setRight(heir);
+    return shrunk;
 }
 
 
@@ -594,6 +996,9 @@ void BinarySearchTree<Key, Value>::clear()
     // TODO
     clearHelper(root_);
     root_ = NULL;
+    leftmost_ = NULL;
+    rightmost_ = NULL;
+    count_ = 0;
 }
 
 
@@ -605,13 +1010,113 @@ Node<Key, Value>*
 BinarySearchTree<Key, Value>::getSmallestNode() const
 {
     // TODO
-    if(root_ == NULL) return NULL;
-    Node<Key, Value>* curr = root_;
-    while(curr->getLeft() != NULL)
-    {
-        curr = curr->getLeft();
+    return leftmost_;
+}
+
+/**
+* A helper function to find the largest node in the tree.
+*/
+template<typename Key, typename Value>
+Node<Key, Value>*
+BinarySearchTree<Key, Value>::getLargestNode() const
+{
+    return rightmost_;
+}
+
+/**
+* Keeps the cached ends and the node count up to date. Call trackInsert()
+* right after linking a new leaf (before any rotation), and trackRemove()
+* while the node to delete is still linked.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::trackInsert(Node<Key, Value>* node)
+{
+    ++count_;
+    Node<Key, Value>* parent = node->getParent();
+    if(parent == NULL) {
+        leftmost_ = node;
+        rightmost_ = node;
+        return;
+    }
+    if(parent == leftmost_ && parent->getLeft() == node) leftmost_ = node;
+    if(parent == rightmost_ && parent->getRight() == node) rightmost_ = node;
+}
+
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::trackRemove(Node<Key, Value>* node)
+{
+    --count_;
+    if(node == leftmost_) leftmost_ = successor(node);
+    if(node == rightmost_) rightmost_ = predecessor(node);
+}
+
+/**
+* Helper that copies the tree at root node by node. It walks the source with
+* the parent pointers instead of recursing, so even a degenerate chain cannot
+* overflow the stack.
+*/
+template<typename Key, typename Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::cloneTree(const Node<Key, Value>* root)
+{
+    if(root == NULL) return NULL;
+    Node<Key, Value>* top = root->clone(NULL);
+    try {
+        const Node<Key, Value>* src = root;
+        Node<Key, Value>* dst = top;
+        while(true) {
+            if(src->getLeft() != NULL && dst->getLeft() == NULL) {
+                dst->setLeft(src->getLeft()->clone(dst));
+                src = src->getLeft();
+                dst = dst->getLeft();
+            }
+            else if(src->getRight() != NULL && dst->getRight() == NULL) {
+                dst->setRight(src->getRight()->clone(dst));
+                src = src->getRight();
+                dst = dst->getRight();
+            }
+            else if(src == root) {
+                break;
+            }
+            else {
+                src = src->getParent();
+                dst = dst->getParent();
+            }
+        }
+    }
+    catch(...) {
+        BinarySearchTree<Key, Value> partial;
+        partial.root_ = top;
+        throw;
     }
-    return curr;
+    return top;
+}
+
+// Helper: recompute the cached ends after root_ was replaced wholesale
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::resetEnds()
+{
+    leftmost_ = root_;
+    rightmost_ = root_;
+    if(root_ == NULL) return;
+    while(leftmost_->getLeft() != NULL) leftmost_ = leftmost_->getLeft();
+    while(rightmost_->getRight() != NULL) rightmost_ = rightmost_->getRight();
+}
+
+/**
+* Helpers for subclasses, which are not friends of the iterator:
+* the node an iterator points at, and an iterator for a node.
+*/
+template<typename Key, typename Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::nodeOf(const iterator& it)
+{
+    return it.current_;
+}
+
+template<typename Key, typename Value>
+typename BinarySearchTree<Key, Value>::iterator
+BinarySearchTree<Key, Value>::iteratorAt(Node<Key, Value>* node)
+{
+    return iterator(node);
 }
 
 /**
@@ -653,6 +1158,170 @@ bool BinarySearchTree<Key, Value>::isBalanced() const
     return heightOrNegOne(root_) != -1;
 }
 
+/**
+* Walks the tree once through the parent pointers, so it needs no recursion
+* and only O(height) extra space for the subtree heights along the path.
+*/
+template<typename Key, typename Value>
+TreeShape BinarySearchTree<Key, Value>::analyze(size_t probes, unsigned seed) const
+{
+    if(probes > 0) return sampleShape(probes, seed);
+
+    TreeShape shape;
+    std::vector<int> leftHeight, rightHeight;
+    double depthSum = 0.0;
+    size_t depth = 0;
+    Node<Key, Value>* prev = NULL;
+    Node<Key, Value>* curr = root_;
+    while(curr != NULL) {
+        Node<Key, Value>* parent = curr->getParent();
+        Node<Key, Value>* left = curr->getLeft();
+        Node<Key, Value>* right = curr->getRight();
+        Node<Key, Value>* next;
+        if(prev == parent) {
+            if(depth == shape.nodesAtLevel.size()) {
+                shape.nodesAtLevel.push_back(0);
+                shape.leavesAtDepth.push_back(0);
+                leftHeight.push_back(0);
+                rightHeight.push_back(0);
+            }
+            ++shape.size;
+            ++shape.nodesAtLevel[depth];
+            depthSum += static_cast<double>(depth + 1);
+            if(left == NULL && right == NULL) ++shape.leavesAtDepth[depth];
+            leftHeight[depth] = rightHeight[depth] = 0;
+            next = (left != NULL) ? left : (right != NULL) ? right : parent;
+        }
+        else if(prev == left && right != NULL) {
+            next = right;
+        }
+        else {
+            next = parent;
+        }
+
+        if(next == parent) {
+            // subtree done: hand its height to the parent
+            int lh = leftHeight[depth];
+            int rh = rightHeight[depth];
+            if(lh - rh > 1 || rh - lh > 1) ++shape.avlViolations;
+            int h = (lh > rh ? lh : rh) + 1;
+            if(parent == NULL) shape.height = h;
+            else if(parent->getLeft() == curr) leftHeight[depth - 1] = h;
+            else rightHeight[depth - 1] = h;
+            if(depth > 0) --depth;
+        }
+        else {
+            ++depth;
+        }
+        prev = curr;
+        curr = next;
+    }
+
+    if(shape.size > 0) shape.averageSearchDepth = depthSum / static_cast<double>(shape.size);
+    return shape;
+}
+
+template<typename Key, typename Value>
+MemoryUsage BinarySearchTree<Key, Value>::memory_usage() const
+{
+    MemoryUsage usage;
+    if(root_ == NULL) return usage;
+
+    // every node of a tree has the same type, so the root stands for all of
+    // them, the rounding of its allocation included
+    size_t nodeSize = root_->footprint();
+    size_t payload = sizeof(Key) + sizeof(Value);
+    size_t slack = allocationSlack(root_);
+    usage.nodes = count_;
+    usage.nodeBytes = count_ * nodeSize;
+    usage.payloadBytes = count_ * payload;
+    usage.overheadBytes = count_ * (nodeSize - payload);
+    usage.estimatedSlackBytes = count_ * slack;
+    return usage;
+}
+
+// ----- Helper: bytes malloc spends on a node beyond the node itself -----
+template<typename Key, typename Value>
+size_t BinarySearchTree<Key, Value>::allocationSlack(const Node<Key, Value>* node)
+{
+    size_t nodeSize = node->footprint();
+#if defined(__GLIBC__)
+    return malloc_usable_size(const_cast<Node<Key, Value>*>(node)) + sizeof(size_t) - nodeSize;
+#else
+    // typical malloc: a one word header, rounded up to 16 bytes
+    return ((nodeSize + sizeof(size_t) + 15) & ~size_t(15)) - nodeSize;
+#endif
+}
+
+template<typename Key, typename Value>
+template<class HeapBytes>
+MemoryUsage BinarySearchTree<Key, Value>::memory_usage(HeapBytes heapBytes) const
+{
+    MemoryUsage usage = memory_usage();
+    for(Node<Key, Value>* node = leftmost_; node != NULL; node = successor(node)) {
+        usage.heapBytes += heapBytes(node->getKey(), node->getValue());
+    }
+    return usage;
+}
+
+/*
+ * Each probe walks from the root to a leaf, picking a child uniformly at
+ * random. The product of the child counts along the way is an unbiased
+ * estimate of how many nodes sit at each level it passes through.
+ */
+template<typename Key, typename Value>
+TreeShape BinarySearchTree<Key, Value>::sampleShape(size_t probes, unsigned seed) const
+{
+    TreeShape shape;
+    shape.sampled = true;
+    if(root_ == NULL) return shape;
+
+    std::vector<double> levels, leaves;
+    uint64_t state = seed * 0x9E3779B97F4A7C15ULL + 1;
+    for(size_t p = 0; p < probes; ++p) {
+        double weight = 1.0;
+        size_t depth = 0;
+        for(Node<Key, Value>* node = root_; node != NULL; ++depth) {
+            if(depth == levels.size()) {
+                levels.push_back(0.0);
+                leaves.push_back(0.0);
+            }
+            levels[depth] += weight;
+
+            Node<Key, Value>* left = node->getLeft();
+            Node<Key, Value>* right = node->getRight();
+            if(left != NULL && right != NULL) {
+                // xorshift64: cheap, and plenty random for picking a side
+                state ^= state << 13;
+                state ^= state >> 7;
+                state ^= state << 17;
+                node = (state & 1) ? right : left;
+                weight *= 2.0;
+            }
+            else if(left != NULL || right != NULL) {
+                node = (left != NULL) ? left : right;
+            }
+            else {
+                leaves[depth] += weight;
+                node = NULL;
+            }
+        }
+    }
+
+    double size = 0.0, depthSum = 0.0;
+    shape.height = static_cast<int>(levels.size());
+    for(size_t d = 0; d < levels.size(); ++d) {
+        double perLevel = levels[d] / static_cast<double>(probes);
+        size += perLevel;
+        depthSum += perLevel * static_cast<double>(d + 1);
+        shape.nodesAtLevel.push_back(static_cast<size_t>(perLevel + 0.5));
+        shape.leavesAtDepth.push_back(static_cast<size_t>(leaves[d] / static_cast<double>(probes) + 0.5));
+    }
+    shape.size = static_cast<size_t>(size + 0.5);
+    shape.averageSearchDepth = depthSum / size;
+    return shape;
+}
+
 
 
 template<typename Key, typename Value>
@@ -737,6 +1406,120 @@ void BinarySearchTree<Key, Value>::nodeSwap( Node<Key,Value>* n1, Node<Key,Value
         this->root_ = n1;
     }
 
+    // the nodes traded places in the in-order sequence too
+    if(leftmost_ == n1) leftmost_ = n2;
+    else if(leftmost_ == n2) leftmost_ = n1;
+    if(rightmost_ == n1) rightmost_ = n2;
+    else if(rightmost_ == n2) rightmost_ = n1;
+
+}
+
+/**
+* Rebalances the tree in place (Day-Stout-Warren): the nodes are first
+* rotated into a sorted right-leaning vine and then folded back into a tree
+* whose levels are all full except possibly the last. Runs in O(n) time and
+* O(1) extra space; no node is allocated, freed or moved, so pointers and
+* iterators to existing items stay valid.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::rebalance()
+{
+    rebalanceSubtree(root_);
+}
+
+// Helper: DSW on the subtree at root; returns the subtree's new root
+template<typename Key, typename Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::rebalanceSubtree(Node<Key, Value>* root)
+{
+    if(root == NULL) return NULL;
+    Node<Key, Value>* parent = root->getParent();
+    bool wasLeft = (parent != NULL && parent->getLeft() == root);
+
+    size_t count = treeToVine(root);
+    Node<Key, Value>* top = (parent == NULL) ? root_ : (wasLeft ? parent->getLeft() : parent->getRight());
+
+    // fold the leftover nodes below a perfect tree first, then halve
+    size_t full = 1;
+    while(full <= count) full = full * 2 + 1;
+    full /= 2;
+    compressVine(top, count - full);
+    top = (parent == NULL) ? root_ : (wasLeft ? parent->getLeft() : parent->getRight());
+    while(full > 1) {
+        full /= 2;
+        compressVine(top, full);
+        top = (parent == NULL) ? root_ : (wasLeft ? parent->getLeft() : parent->getRight());
+    }
+    return top;
+}
+
+// Helper: left rotation around x that keeps parent pointers and root_ right
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::rotateLeftAt(Node<Key, Value>* x)
+{
+    Node<Key, Value>* y = x->getRight();
+    Node<Key, Value>* p = x->getParent();
+    Node<Key, Value>* beta = y->getLeft();
+
+    x->setRight(beta);
+    if(beta != NULL) beta->setParent(x);
+    y->setLeft(x);
+    x->setParent(y);
+
+    y->setParent(p);
+    if(p == NULL) root_ = y;
+    else if(p->getLeft() == x) p->setLeft(y);
+    else p->setRight(y);
+}
+
+// Helper: right rotation around x, mirror of rotateLeftAt
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::rotateRightAt(Node<Key, Value>* x)
+{
+    Node<Key, Value>* y = x->getLeft();
+    Node<Key, Value>* p = x->getParent();
+    Node<Key, Value>* beta = y->getRight();
+
+    x->setLeft(beta);
+    if(beta != NULL) beta->setParent(x);
+    y->setRight(x);
+    x->setParent(y);
+
+    y->setParent(p);
+    if(p == NULL) root_ = y;
+    else if(p->getLeft() == x) p->setLeft(y);
+    else p->setRight(y);
+}
+
+// Helper: rotate the subtree at root into a right-leaning vine; returns its size
+template<typename Key, typename Value>
+size_t BinarySearchTree<Key, Value>::treeToVine(Node<Key, Value>* root)
+{
+    size_t count = 0;
+    Node<Key, Value>* curr = root;
+    while(curr != NULL) {
+        if(curr->getLeft() != NULL) {
+            Node<Key, Value>* left = curr->getLeft();
+            rotateRightAt(curr);
+            curr = left;
+        }
+        else {
+            ++count;
+            curr = curr->getRight();
+        }
+    }
+    return count;
+}
+
+// Helper: left-rotate every other node down the vine starting at top, count times
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::compressVine(Node<Key, Value>* top, size_t count)
+{
+    Node<Key, Value>* curr = top;
+    for(size_t i = 0; i < count && curr != NULL && curr->getRight() != NULL; ++i) {
+        Node<Key, Value>* next = curr->getRight();
+        rotateLeftAt(curr);
+        curr = next->getRight();
+    }
 }
 
 // Helper: delete all nodes in post-order
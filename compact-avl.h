@@ -0,0 +1,590 @@
+#ifndef COMPACT_AVL_H
+#define COMPACT_AVL_H
+
+#include <iostream>
+#include <stdexcept>
+#include <cstdint>
+#include <cstdlib>
+#include <utility>
+#include <vector>
+
+/**
+* Maximum height of a compact AVL tree. An AVL tree of height h has at least
+* fib(h + 2) - 1 nodes, so 92 levels already cover more nodes than fit in a
+* 64 bit address space; the descent paths that insert() and remove() keep
+* on the call stack are sized with some slack.
+*/
+#define COMPACT_AVL_MAX_HEIGHT 96
+
+/**
+* A node for CompactAVLTree. There is no parent pointer and no vtable, and
+* the balance (-1, 0 or +1, stored as 0..2) lives in the two low bits of the
+* left child pointer, which are always zero because nodes are pointer aligned.
+* That is 16 bytes of overhead per entry instead of the 40 of an AVLNode.
+*/
+template <typename Key, typename Value>
+class CompactAVLNode
+{
+public:
+    CompactAVLNode(const Key& key, const Value& value);
+
+    const std::pair<const Key, Value>& getItem() const { return item_; }
+    std::pair<const Key, Value>& getItem() { return item_; }
+    const Key& getKey() const { return item_.first; }
+    Value& getValue() { return item_.second; }
+    const Value& getValue() const { return item_.second; }
+
+    CompactAVLNode* getLeft() const;
+    CompactAVLNode* getRight() const;
+    CompactAVLNode* getChild(int dir) const;
+    int8_t getBalance() const;
+
+    void setLeft(CompactAVLNode* left);
+    void setRight(CompactAVLNode* right);
+    void setChild(int dir, CompactAVLNode* child);
+    void setBalance(int8_t balance);
+
+protected:
+    uintptr_t leftAndBalance_;
+    CompactAVLNode* right_;
+    std::pair<const Key, Value> item_;
+};
+
+/*
+  ---------------------------------------------------
+  Begin implementations for the CompactAVLNode class.
+  ---------------------------------------------------
+*/
+
+template<typename Key, typename Value>
+CompactAVLNode<Key, Value>::CompactAVLNode(const Key& key, const Value& value) :
+    leftAndBalance_(1), right_(NULL), item_(key, value)
+{
+
+}
+
+template<typename Key, typename Value>
+CompactAVLNode<Key, Value>* CompactAVLNode<Key, Value>::getLeft() const
+{
+    return reinterpret_cast<CompactAVLNode*>(leftAndBalance_ & ~static_cast<uintptr_t>(3));
+}
+
+template<typename Key, typename Value>
+CompactAVLNode<Key, Value>* CompactAVLNode<Key, Value>::getRight() const
+{
+    return right_;
+}
+
+// dir 0 is left, dir 1 is right
+template<typename Key, typename Value>
+CompactAVLNode<Key, Value>* CompactAVLNode<Key, Value>::getChild(int dir) const
+{
+    return dir == 0 ? getLeft() : right_;
+}
+
+/**
+* Balance is height(left) - height(right), like AVLNode.
+*/
+template<typename Key, typename Value>
+int8_t CompactAVLNode<Key, Value>::getBalance() const
+{
+    return static_cast<int8_t>(leftAndBalance_ & 3) - 1;
+}
+
+template<typename Key, typename Value>
+void CompactAVLNode<Key, Value>::setLeft(CompactAVLNode* left)
+{
+    leftAndBalance_ = reinterpret_cast<uintptr_t>(left) | (leftAndBalance_ & 3);
+}
+
+template<typename Key, typename Value>
+void CompactAVLNode<Key, Value>::setRight(CompactAVLNode* right)
+{
+    right_ = right;
+}
+
+template<typename Key, typename Value>
+void CompactAVLNode<Key, Value>::setChild(int dir, CompactAVLNode* child)
+{
+    if(dir == 0) setLeft(child);
+    else right_ = child;
+}
+
+template<typename Key, typename Value>
+void CompactAVLNode<Key, Value>::setBalance(int8_t balance)
+{
+    leftAndBalance_ = (leftAndBalance_ & ~static_cast<uintptr_t>(3)) | static_cast<uintptr_t>(balance + 1);
+}
+
+/*
+  -------------------------------------------------
+  End implementations for the CompactAVLNode class.
+  -------------------------------------------------
+*/
+
+/**
+* An AVL tree built from CompactAVLNodes. Since nodes do not know their
+* parent, insert/remove record the descent path on a bounded stack and
+* retrace along it, and iterators keep the ancestors still to be visited.
+*
+* An iterator is the current node plus that stack, which only ever holds
+* as many entries as the tree is high. It is filled in by begin() or, for
+* an iterator from find(), by the first ++ (one more descent), so a lookup
+* allocates nothing and its iterator is cheap to copy.
+*/
+template <typename Key, typename Value>
+class CompactAVLTree
+{
+public:
+    typedef CompactAVLNode<Key, Value> NodeType;
+
+    CompactAVLTree();
+    ~CompactAVLTree();
+
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    void clear();
+    bool isBalanced() const;
+    bool empty() const;
+
+    class iterator
+    {
+    public:
+        iterator();
+
+        std::pair<const Key,Value>& operator*() const;
+        std::pair<const Key,Value>* operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+
+    protected:
+        friend class CompactAVLTree<Key, Value>;
+        iterator(const CompactAVLTree<Key, Value>* tree, NodeType* node);
+        void descendLeft(NodeType* node);
+        void findAncestors();
+
+        const CompactAVLTree<Key, Value>* tree_;
+        NodeType* node_;
+        // ancestors after node_ in order, the nearest on top; valid if stacked_
+        std::vector<NodeType*> stack_;
+        bool stacked_;
+    };
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    Value& operator[](const Key& key);
+    Value const & operator[](const Key& key) const;
+
+protected:
+    NodeType* internalFind(const Key& key) const;
+    NodeType* rotate(NodeType* x, int dir);
+    NodeType* rotateDouble(NodeType* x, int dir);
+    void clearHelper(NodeType* root);
+    int heightOrNegOne(NodeType* root) const;
+
+private:
+    CompactAVLTree(const CompactAVLTree&);
+    CompactAVLTree& operator=(const CompactAVLTree&);
+
+    NodeType* root_;
+};
+
+/*
+  ----------------------------------------------------------
+  Begin implementations for the CompactAVLTree::iterator class.
+  ----------------------------------------------------------
+*/
+
+template<typename Key, typename Value>
+CompactAVLTree<Key, Value>::iterator::iterator() :
+    tree_(NULL), node_(NULL), stacked_(false)
+{
+
+}
+
+template<typename Key, typename Value>
+CompactAVLTree<Key, Value>::iterator::iterator(const CompactAVLTree<Key, Value>* tree, NodeType* node) :
+    tree_(tree), node_(node), stacked_(false)
+{
+
+}
+
+template<typename Key, typename Value>
+std::pair<const Key,Value>& CompactAVLTree<Key, Value>::iterator::operator*() const
+{
+    return node_->getItem();
+}
+
+template<typename Key, typename Value>
+std::pair<const Key,Value>* CompactAVLTree<Key, Value>::iterator::operator->() const
+{
+    return &(node_->getItem());
+}
+
+template<typename Key, typename Value>
+bool CompactAVLTree<Key, Value>::iterator::operator==(const iterator& rhs) const
+{
+    return node_ == rhs.node_;
+}
+
+template<typename Key, typename Value>
+bool CompactAVLTree<Key, Value>::iterator::operator!=(const iterator& rhs) const
+{
+    return !(*this == rhs);
+}
+
+// Helper: moves to the smallest node under node, stacking the ones passed
+template<typename Key, typename Value>
+void CompactAVLTree<Key, Value>::iterator::descendLeft(NodeType* node)
+{
+    while(node->getLeft() != NULL) {
+        stack_.push_back(node);
+        node = node->getLeft();
+    }
+    node_ = node;
+}
+
+/**
+* The ancestors we turn left at on the way down to node_ are exactly the
+* ones that come after it in order.
+*/
+template<typename Key, typename Value>
+void CompactAVLTree<Key, Value>::iterator::findAncestors()
+{
+    stack_.clear();
+    const Key& key = node_->getKey();
+    for(NodeType* curr = tree_->root_; curr != node_; ) {
+        if(key < curr->getKey()) {
+            stack_.push_back(curr);
+            curr = curr->getLeft();
+        }
+        else {
+            curr = curr->getRight();
+        }
+    }
+    stacked_ = true;
+}
+
+template<typename Key, typename Value>
+typename CompactAVLTree<Key, Value>::iterator&
+CompactAVLTree<Key, Value>::iterator::operator++()
+{
+    if(node_ == NULL) return *this;
+    if(!stacked_) findAncestors();
+
+    if(node_->getRight() != NULL) {
+        descendLeft(node_->getRight());
+    }
+    else if(stack_.empty()) {
+        node_ = NULL;
+    }
+    else {
+        node_ = stack_.back();
+        stack_.pop_back();
+    }
+    return *this;
+}
+
+/*
+  --------------------------------------------------------
+  End implementations for the CompactAVLTree::iterator class.
+  --------------------------------------------------------
+*/
+
+/*
+  -------------------------------------------------
+  Begin implementations for the CompactAVLTree class.
+  -------------------------------------------------
+*/
+
+template<typename Key, typename Value>
+CompactAVLTree<Key, Value>::CompactAVLTree() : root_(NULL)
+{
+
+}
+
+template<typename Key, typename Value>
+CompactAVLTree<Key, Value>::~CompactAVLTree()
+{
+    clear();
+}
+
+template<typename Key, typename Value>
+void CompactAVLTree<Key, Value>::clear()
+{
+    clearHelper(root_);
+    root_ = NULL;
+}
+
+template<typename Key, typename Value>
+bool CompactAVLTree<Key, Value>::empty() const
+{
+    return root_ == NULL;
+}
+
+template<typename Key, typename Value>
+bool CompactAVLTree<Key, Value>::isBalanced() const
+{
+    return heightOrNegOne(root_) != -1;
+}
+
+template<typename Key, typename Value>
+typename CompactAVLTree<Key, Value>::iterator CompactAVLTree<Key, Value>::begin() const
+{
+    iterator it(this, NULL);
+    if(root_ == NULL) return it;
+    it.descendLeft(root_);
+    it.stacked_ = true;
+    return it;
+}
+
+template<typename Key, typename Value>
+typename CompactAVLTree<Key, Value>::iterator CompactAVLTree<Key, Value>::end() const
+{
+    return iterator();
+}
+
+template<typename Key, typename Value>
+typename CompactAVLTree<Key, Value>::iterator CompactAVLTree<Key, Value>::find(const Key& key) const
+{
+    NodeType* node = internalFind(key);
+    return node == NULL ? end() : iterator(this, node);
+}
+
+template<typename Key, typename Value>
+typename CompactAVLTree<Key, Value>::NodeType* CompactAVLTree<Key, Value>::internalFind(const Key& key) const
+{
+    NodeType* curr = root_;
+    while(curr != NULL) {
+        if(key < curr->getKey()) curr = curr->getLeft();
+        else if(curr->getKey() < key) curr = curr->getRight();
+        else return curr;
+    }
+    return NULL;
+}
+
+template<typename Key, typename Value>
+Value& CompactAVLTree<Key, Value>::operator[](const Key& key)
+{
+    NodeType* curr = internalFind(key);
+    if(curr == NULL) throw std::out_of_range("Invalid key");
+    return curr->getValue();
+}
+
+template<typename Key, typename Value>
+Value const & CompactAVLTree<Key, Value>::operator[](const Key& key) const
+{
+    NodeType* curr = internalFind(key);
+    if(curr == NULL) throw std::out_of_range("Invalid key");
+    return curr->getValue();
+}
+
+/**
+* Single rotation that lifts x's child on side 1 - dir, i.e. dir == 0 is a
+* left rotation. Returns the new subtree root; balances are fixed by callers.
+*/
+template<typename Key, typename Value>
+typename CompactAVLTree<Key, Value>::NodeType* CompactAVLTree<Key, Value>::rotate(NodeType* x, int dir)
+{
+    NodeType* y = x->getChild(1 - dir);
+    x->setChild(1 - dir, y->getChild(dir));
+    y->setChild(dir, x);
+    return y;
+}
+
+/**
+* Rebalances x whose side 1 - dir is two levels too tall. Returns the new
+* subtree root with all touched balances updated.
+*/
+template<typename Key, typename Value>
+typename CompactAVLTree<Key, Value>::NodeType* CompactAVLTree<Key, Value>::rotateDouble(NodeType* x, int dir)
+{
+    // sign of "heavy on side 1 - dir" in left-minus-right terms
+    const int8_t heavy = (dir == 0) ? -1 : 1;
+    NodeType* y = x->getChild(1 - dir);
+
+    if(y->getBalance() != -heavy) {
+        // single rotation
+        NodeType* top = rotate(x, dir);
+        if(y->getBalance() == 0) {
+            // only possible on removal
+            x->setBalance(heavy);
+            y->setBalance(-heavy);
+        }
+        else {
+            x->setBalance(0);
+            y->setBalance(0);
+        }
+        return top;
+    }
+
+    // double rotation through z
+    NodeType* z = y->getChild(dir);
+    int8_t zb = z->getBalance();
+    x->setChild(1 - dir, rotate(y, 1 - dir));
+    NodeType* top = rotate(x, dir);
+    x->setBalance(zb == heavy ? -heavy : 0);
+    y->setBalance(zb == -heavy ? heavy : 0);
+    z->setBalance(0);
+    return top;
+}
+
+template<typename Key, typename Value>
+void CompactAVLTree<Key, Value>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    const Key& key = keyValuePair.first;
+
+    NodeType* path[COMPACT_AVL_MAX_HEIGHT];
+    int dirs[COMPACT_AVL_MAX_HEIGHT];
+    int depth = 0;
+
+    NodeType* curr = root_;
+    while(curr != NULL) {
+        int dir;
+        if(key < curr->getKey()) dir = 0;
+        else if(curr->getKey() < key) dir = 1;
+        else {
+            curr->getValue() = keyValuePair.second;
+            return;
+        }
+        path[depth] = curr;
+        dirs[depth] = dir;
+        ++depth;
+        curr = curr->getChild(dir);
+    }
+
+    NodeType* node = new NodeType(key, keyValuePair.second);
+    if(depth == 0) {
+        root_ = node;
+        return;
+    }
+    path[depth - 1]->setChild(dirs[depth - 1], node);
+
+    // retrace: the subtree on side dirs[i] of path[i] grew by one
+    for(int i = depth - 1; i >= 0; --i) {
+        NodeType* p = path[i];
+        int8_t b = p->getBalance() + (dirs[i] == 0 ? 1 : -1);
+        if(b == 0) {
+            p->setBalance(0);
+            return;
+        }
+        if(b == 1 || b == -1) {
+            p->setBalance(b);
+            continue;
+        }
+        // |b| == 2: the side we came from is too tall
+        NodeType* top = rotateDouble(p, 1 - dirs[i]);
+        if(i == 0) root_ = top;
+        else path[i - 1]->setChild(dirs[i - 1], top);
+        return;
+    }
+}
+
+template<typename Key, typename Value>
+void CompactAVLTree<Key, Value>::remove(const Key& key)
+{
+    NodeType* path[COMPACT_AVL_MAX_HEIGHT];
+    int dirs[COMPACT_AVL_MAX_HEIGHT];
+    int depth = 0;
+
+    NodeType* curr = root_;
+    while(curr != NULL) {
+        int dir;
+        if(key < curr->getKey()) dir = 0;
+        else if(curr->getKey() < key) dir = 1;
+        else break;
+        path[depth] = curr;
+        dirs[depth] = dir;
+        ++depth;
+        curr = curr->getChild(dir);
+    }
+    if(curr == NULL) return;
+
+    NodeType* target = curr;
+    if(target->getLeft() != NULL && target->getRight() != NULL) {
+        // swap positions with the predecessor, like the BST removal does
+        int t = depth;
+        path[depth] = target;
+        dirs[depth] = 0;
+        ++depth;
+        NodeType* pred = target->getLeft();
+        while(pred->getRight() != NULL) {
+            path[depth] = pred;
+            dirs[depth] = 1;
+            ++depth;
+            pred = pred->getRight();
+        }
+
+        // unlink pred, then put it where target was
+        path[depth - 1]->setChild(dirs[depth - 1], pred->getLeft());
+        pred->setLeft(target->getLeft());
+        pred->setRight(target->getRight());
+        pred->setBalance(target->getBalance());
+        if(t == 0) root_ = pred;
+        else path[t - 1]->setChild(dirs[t - 1], pred);
+        path[t] = pred;
+    }
+    else {
+        NodeType* child = target->getLeft() != NULL ? target->getLeft() : target->getRight();
+        if(depth == 0) root_ = child;
+        else path[depth - 1]->setChild(dirs[depth - 1], child);
+    }
+    delete target;
+
+    // retrace: the subtree on side dirs[i] of path[i] shrank by one
+    for(int i = depth - 1; i >= 0; --i) {
+        NodeType* p = path[i];
+        int8_t b = p->getBalance() + (dirs[i] == 0 ? -1 : 1);
+        if(b == 1 || b == -1) {
+            p->setBalance(b);
+            return;
+        }
+        if(b == 0) {
+            p->setBalance(0);
+            continue;
+        }
+        NodeType* top = rotateDouble(p, dirs[i]);
+        if(i == 0) root_ = top;
+        else path[i - 1]->setChild(dirs[i - 1], top);
+        // the subtree kept its height: nothing above changes
+        if(top->getBalance() != 0) return;
+    }
+}
+
+template<typename Key, typename Value>
+void CompactAVLTree<Key, Value>::clearHelper(NodeType* root)
+{
+    if(root == NULL) return;
+    clearHelper(root->getLeft());
+    clearHelper(root->getRight());
+    delete root;
+}
+
+template<typename Key, typename Value>
+int CompactAVLTree<Key, Value>::heightOrNegOne(NodeType* root) const
+{
+    if(root == NULL) return 0;
+
+    int lh = heightOrNegOne(root->getLeft());
+    if(lh == -1) return -1;
+
+    int rh = heightOrNegOne(root->getRight());
+    if(rh == -1) return -1;
+
+    if(lh - rh > 1 || rh - lh > 1) return -1;
+    if(root->getBalance() != lh - rh) return -1;
+
+    return (lh > rh ? lh : rh) + 1;
+}
+
+/*
+  -----------------------------------------------
+  End implementations for the CompactAVLTree class.
+  -----------------------------------------------
+*/
+
+#endif
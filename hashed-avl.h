@@ -0,0 +1,313 @@
+#ifndef HASHED_AVL_H
+#define HASHED_AVL_H
+
+#include <iostream>
+#include <exception>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+#include "avlbst.h"
+
+/**
+* An AVLTree with an open addressing hash index from each key to its node,
+* for workloads dominated by point lookups. find(), operator[] and remove()
+* locate the node through the index in O(1) expected time; iteration, the
+* ordered operations and every structural change still go through the tree.
+*
+* The index holds node pointers, and nodes never change their key, so it
+* only changes when a node is created or freed: createNode() adds the node
+* and removeNode() drops it. Rotations, and the splice that moves a
+* removed node's heir into its place, move nodes around the tree but keep
+* them, so the index needs no update for them.
+*
+* The table uses linear probing with backward shift deletion (no
+* tombstones) and is kept at most half full; it costs about two pointers
+* per item. Keys need Hash and operator== on top of operator<, and the
+* two must agree.
+*/
+template <class Key, class Value, class Hash = std::hash<Key> >
+class HashedAVLTree : public AVLTree<Key, Value>
+{
+public:
+    typedef typename AVLTree<Key, Value>::iterator iterator;
+
+    HashedAVLTree();
+    HashedAVLTree(const HashedAVLTree& other);
+    HashedAVLTree(HashedAVLTree&& other);
+    HashedAVLTree& operator=(const HashedAVLTree& other);
+    HashedAVLTree& operator=(HashedAVLTree&& other);
+    void swap(HashedAVLTree& other);
+
+    virtual void remove(const Key& key);
+    virtual void clear();
+
+    iterator find(const Key& key) const;
+    Value& operator[](const Key& key);
+    Value const & operator[](const Key& key) const;
+
+    virtual void load(std::istream& is);
+    void load(const std::string& path);
+
+protected:
+    virtual AVLNode<Key,Value>* createNode(const Key& key, const Value& value, AVLNode<Key,Value>* parent);
+    virtual void removeNode(Node<Key,Value>* node, bool bySuccessor);
+
+    Node<Key, Value>* lookup(const Key& key) const;
+    size_t home(const Key& key) const;
+    void indexInsert(Node<Key, Value>* node);
+    void indexErase(const Key& key);
+    void reserveFor(size_t count);
+    void reindex();
+
+    std::vector<Node<Key, Value>*> slots_;
+    size_t indexed_;
+    int shift_;
+    bool indexing_;
+    Hash hash_;
+};
+
+/*
+  -------------------------------------------------
+  Begin implementations for the HashedAVLTree class.
+  -------------------------------------------------
+*/
+
+template<class Key, class Value, class Hash>
+HashedAVLTree<Key, Value, Hash>::HashedAVLTree() :
+    AVLTree<Key, Value>(), slots_(), indexed_(0), shift_(64), indexing_(true), hash_()
+{
+
+}
+
+template<class Key, class Value, class Hash>
+HashedAVLTree<Key, Value, Hash>::HashedAVLTree(const HashedAVLTree& other) :
+    AVLTree<Key, Value>(other), slots_(), indexed_(0), shift_(64), indexing_(true), hash_(other.hash_)
+{
+    reindex();
+}
+
+template<class Key, class Value, class Hash>
+HashedAVLTree<Key, Value, Hash>::HashedAVLTree(HashedAVLTree&& other) :
+    AVLTree<Key, Value>(std::move(other)), slots_(std::move(other.slots_)), indexed_(other.indexed_),
+    shift_(other.shift_), indexing_(true), hash_(other.hash_)
+{
+    other.slots_.clear();
+    other.indexed_ = 0;
+    other.shift_ = 64;
+}
+
+template<class Key, class Value, class Hash>
+HashedAVLTree<Key, Value, Hash>& HashedAVLTree<Key, Value, Hash>::operator=(const HashedAVLTree& other)
+{
+    if(this != &other) {
+        HashedAVLTree<Key, Value, Hash> copy(other);
+        swap(copy);
+    }
+    return *this;
+}
+
+template<class Key, class Value, class Hash>
+HashedAVLTree<Key, Value, Hash>& HashedAVLTree<Key, Value, Hash>::operator=(HashedAVLTree&& other)
+{
+    if(this != &other) {
+        clear();
+        swap(other);
+    }
+    return *this;
+}
+
+template<class Key, class Value, class Hash>
+void HashedAVLTree<Key, Value, Hash>::swap(HashedAVLTree& other)
+{
+    AVLTree<Key, Value>::swap(other);
+    slots_.swap(other.slots_);
+    std::swap(indexed_, other.indexed_);
+    std::swap(shift_, other.shift_);
+    std::swap(hash_, other.hash_);
+}
+
+template<class Key, class Value, class Hash>
+void HashedAVLTree<Key, Value, Hash>::remove(const Key& key)
+{
+    Node<Key, Value>* node = lookup(key);
+    if(node != NULL) removeNode(node, false);
+}
+
+template<class Key, class Value, class Hash>
+void HashedAVLTree<Key, Value, Hash>::clear()
+{
+    BinarySearchTree<Key, Value>::clear();
+    slots_.clear();
+    indexed_ = 0;
+    shift_ = 64;
+}
+
+template<class Key, class Value, class Hash>
+typename HashedAVLTree<Key, Value, Hash>::iterator
+HashedAVLTree<Key, Value, Hash>::find(const Key& key) const
+{
+    return BinarySearchTree<Key, Value>::iteratorAt(lookup(key));
+}
+
+template<class Key, class Value, class Hash>
+Value& HashedAVLTree<Key, Value, Hash>::operator[](const Key& key)
+{
+    Node<Key, Value>* node = lookup(key);
+    if(node == NULL) throw std::out_of_range("Invalid key");
+    return node->getValue();
+}
+
+template<class Key, class Value, class Hash>
+Value const & HashedAVLTree<Key, Value, Hash>::operator[](const Key& key) const
+{
+    Node<Key, Value>* node = lookup(key);
+    if(node == NULL) throw std::out_of_range("Invalid key");
+    return node->getValue();
+}
+
+/*
+ * AVLTree::load() builds the new nodes before it frees the old ones, so
+ * they are not indexed one by one; the index is rebuilt from whichever
+ * tree is left.
+ */
+template<class Key, class Value, class Hash>
+void HashedAVLTree<Key, Value, Hash>::load(std::istream& is)
+{
+    indexing_ = false;
+    try {
+        AVLTree<Key, Value>::load(is);
+    }
+    catch(...) {
+        indexing_ = true;
+        reindex();
+        throw;
+    }
+    indexing_ = true;
+    reindex();
+}
+
+template<class Key, class Value, class Hash>
+void HashedAVLTree<Key, Value, Hash>::load(const std::string& path)
+{
+    std::ifstream ifile(path.c_str(), std::ios::binary);
+    if(!ifile) throw std::runtime_error("cannot open " + path);
+    load(ifile);
+}
+
+// Room is made before the node exists, so a failed allocation leaks nothing
+template<class Key, class Value, class Hash>
+AVLNode<Key,Value>* HashedAVLTree<Key, Value, Hash>::createNode(const Key& key, const Value& value,
+                                                                AVLNode<Key,Value>* parent)
+{
+    if(!indexing_) return AVLTree<Key, Value>::createNode(key, value, parent);
+    reserveFor(indexed_ + 1);
+    AVLNode<Key,Value>* node = AVLTree<Key, Value>::createNode(key, value, parent);
+    indexInsert(node);
+    return node;
+}
+
+template<class Key, class Value, class Hash>
+void HashedAVLTree<Key, Value, Hash>::removeNode(Node<Key,Value>* node, bool bySuccessor)
+{
+    indexErase(node->getKey());
+    AVLTree<Key, Value>::removeNode(node, bySuccessor);
+}
+
+template<class Key, class Value, class Hash>
+Node<Key, Value>* HashedAVLTree<Key, Value, Hash>::lookup(const Key& key) const
+{
+    if(slots_.empty()) return NULL;
+    size_t mask = slots_.size() - 1;
+    for(size_t i = home(key); slots_[i] != NULL; i = (i + 1) & mask) {
+        if(slots_[i]->getKey() == key) return slots_[i];
+    }
+    return NULL;
+}
+
+// ----- Helper: Fibonacci hashing spreads even an identity std::hash -----
+template<class Key, class Value, class Hash>
+size_t HashedAVLTree<Key, Value, Hash>::home(const Key& key) const
+{
+    uint64_t h = static_cast<uint64_t>(hash_(key)) * 0x9E3779B97F4A7C15ULL;
+    return shift_ >= 64 ? 0 : static_cast<size_t>(h >> shift_);
+}
+
+template<class Key, class Value, class Hash>
+void HashedAVLTree<Key, Value, Hash>::indexInsert(Node<Key, Value>* node)
+{
+    size_t mask = slots_.size() - 1;
+    size_t i = home(node->getKey());
+    while(slots_[i] != NULL) i = (i + 1) & mask;
+    slots_[i] = node;
+    ++indexed_;
+}
+
+/*
+ * Backward shift deletion: later entries of the probe run move into the
+ * hole unless that would put them before their home slot.
+ */
+template<class Key, class Value, class Hash>
+void HashedAVLTree<Key, Value, Hash>::indexErase(const Key& key)
+{
+    if(slots_.empty()) return;
+    size_t mask = slots_.size() - 1;
+    size_t hole = home(key);
+    while(slots_[hole] != NULL && !(slots_[hole]->getKey() == key)) hole = (hole + 1) & mask;
+    if(slots_[hole] == NULL) return;
+
+    for(size_t i = (hole + 1) & mask; slots_[i] != NULL; i = (i + 1) & mask) {
+        size_t want = home(slots_[i]->getKey());
+        // moving i to hole is fine unless want lies cyclically in (hole, i]
+        if(((i - want) & mask) >= ((i - hole) & mask)) {
+            slots_[hole] = slots_[i];
+            hole = i;
+        }
+    }
+    slots_[hole] = NULL;
+    --indexed_;
+}
+
+// Doubles the table until count items fill at most half of it
+template<class Key, class Value, class Hash>
+void HashedAVLTree<Key, Value, Hash>::reserveFor(size_t count)
+{
+    if(2 * count <= slots_.size()) return;
+
+    size_t capacity = 16;
+    int shift = 60;
+    while(capacity < 2 * count) {
+        capacity *= 2;
+        --shift;
+    }
+    std::vector<Node<Key, Value>*> old(capacity, NULL);
+    old.swap(slots_);
+    shift_ = shift;
+    indexed_ = 0;
+    for(size_t i = 0; i < old.size(); ++i) {
+        if(old[i] != NULL) indexInsert(old[i]);
+    }
+}
+
+template<class Key, class Value, class Hash>
+void HashedAVLTree<Key, Value, Hash>::reindex()
+{
+    slots_.clear();
+    indexed_ = 0;
+    shift_ = 64;
+    reserveFor(this->size());
+    for(iterator it = this->begin(); it != this->end(); ++it) {
+        indexInsert(BinarySearchTree<Key, Value>::nodeOf(it));
+    }
+}
+
+/*
+  -----------------------------------------------
+  End implementations for the HashedAVLTree class.
+  -----------------------------------------------
+*/
+
+#endif
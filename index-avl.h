@@ -0,0 +1,497 @@
+#ifndef INDEX_AVL_H
+#define INDEX_AVL_H
+
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
+#include <utility>
+
+/**
+* An AVL tree whose nodes live in contiguous vectors and link to each other
+* with 32 bit indices instead of pointers.
+*
+* The node fields are kept as a structure of arrays: keys, values, links
+* (left/right/parent) and balances each have their own vector, so a search
+* only touches the key and link arrays. Since nothing stores an address, the
+* whole tree can be copied or relocated as plain vectors.
+*
+* Removal keeps the arrays dense by moving the last slot into the freed one,
+* so (like std::vector) removing invalidates iterators.
+*/
+template <typename Key, typename Value>
+class IndexAVLTree
+{
+public:
+    typedef uint32_t Index;
+    static const Index NIL = 0xFFFFFFFFu;
+
+    IndexAVLTree();
+
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    void clear();
+    bool isBalanced() const;
+    bool empty() const;
+    size_t size() const;
+    // reserve room for n entries in every array
+    void reserve(size_t n);
+
+    /**
+    * What the iterator points at: references into the key and value arrays,
+    * so that it->first / it->second read like a std::pair.
+    */
+    struct ItemRef
+    {
+        const Key& first;
+        Value& second;
+        ItemRef* operator->() { return this; }
+    };
+
+    class iterator
+    {
+    public:
+        iterator();
+
+        ItemRef operator*() const;
+        ItemRef operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+
+    protected:
+        friend class IndexAVLTree<Key, Value>;
+        iterator(const IndexAVLTree<Key, Value>* tree, Index current);
+        const IndexAVLTree<Key, Value>* tree_;
+        Index current_;
+    };
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    Value& operator[](const Key& key);
+    Value const & operator[](const Key& key) const;
+
+protected:
+    struct Links
+    {
+        Index left;
+        Index right;
+        Index parent;
+    };
+
+    Index internalFind(const Key& key) const;
+    Index successor(Index n) const;
+    Index& childRef(Index parent, Index child);
+    Index rotate(Index x, bool left);
+    Index fixup(Index x, bool tallLeft);
+    void releaseSlot(Index n);
+    int heightOrNegOne(Index n) const;
+
+    std::vector<Key> keys_;
+    mutable std::vector<Value> values_;
+    std::vector<Links> links_;
+    std::vector<int8_t> balance_;   // height(left) - height(right)
+    Index root_;
+};
+
+/*
+  --------------------------------------------------------
+  Begin implementations for the IndexAVLTree::iterator class.
+  --------------------------------------------------------
+*/
+
+template<typename Key, typename Value>
+IndexAVLTree<Key, Value>::iterator::iterator() : tree_(NULL), current_(NIL)
+{
+
+}
+
+template<typename Key, typename Value>
+IndexAVLTree<Key, Value>::iterator::iterator(const IndexAVLTree<Key, Value>* tree, Index current) :
+    tree_(tree), current_(current)
+{
+
+}
+
+template<typename Key, typename Value>
+typename IndexAVLTree<Key, Value>::ItemRef IndexAVLTree<Key, Value>::iterator::operator*() const
+{
+    ItemRef ref = { tree_->keys_[current_], tree_->values_[current_] };
+    return ref;
+}
+
+template<typename Key, typename Value>
+typename IndexAVLTree<Key, Value>::ItemRef IndexAVLTree<Key, Value>::iterator::operator->() const
+{
+    return **this;
+}
+
+template<typename Key, typename Value>
+bool IndexAVLTree<Key, Value>::iterator::operator==(const iterator& rhs) const
+{
+    return current_ == rhs.current_;
+}
+
+template<typename Key, typename Value>
+bool IndexAVLTree<Key, Value>::iterator::operator!=(const iterator& rhs) const
+{
+    return current_ != rhs.current_;
+}
+
+template<typename Key, typename Value>
+typename IndexAVLTree<Key, Value>::iterator& IndexAVLTree<Key, Value>::iterator::operator++()
+{
+    if(current_ != NIL) {
+        current_ = tree_->successor(current_);
+    }
+    return *this;
+}
+
+/*
+  ------------------------------------------------------
+  End implementations for the IndexAVLTree::iterator class.
+  ------------------------------------------------------
+*/
+
+/*
+  -----------------------------------------------
+  Begin implementations for the IndexAVLTree class.
+  -----------------------------------------------
+*/
+
+template<typename Key, typename Value>
+const typename IndexAVLTree<Key, Value>::Index IndexAVLTree<Key, Value>::NIL;
+
+template<typename Key, typename Value>
+IndexAVLTree<Key, Value>::IndexAVLTree() : root_(NIL)
+{
+
+}
+
+template<typename Key, typename Value>
+void IndexAVLTree<Key, Value>::clear()
+{
+    keys_.clear();
+    values_.clear();
+    links_.clear();
+    balance_.clear();
+    root_ = NIL;
+}
+
+template<typename Key, typename Value>
+bool IndexAVLTree<Key, Value>::empty() const
+{
+    return root_ == NIL;
+}
+
+template<typename Key, typename Value>
+size_t IndexAVLTree<Key, Value>::size() const
+{
+    return keys_.size();
+}
+
+template<typename Key, typename Value>
+void IndexAVLTree<Key, Value>::reserve(size_t n)
+{
+    keys_.reserve(n);
+    values_.reserve(n);
+    links_.reserve(n);
+    balance_.reserve(n);
+}
+
+template<typename Key, typename Value>
+bool IndexAVLTree<Key, Value>::isBalanced() const
+{
+    return heightOrNegOne(root_) != -1;
+}
+
+template<typename Key, typename Value>
+typename IndexAVLTree<Key, Value>::iterator IndexAVLTree<Key, Value>::begin() const
+{
+    Index curr = root_;
+    if(curr != NIL) {
+        while(links_[curr].left != NIL) curr = links_[curr].left;
+    }
+    return iterator(this, curr);
+}
+
+template<typename Key, typename Value>
+typename IndexAVLTree<Key, Value>::iterator IndexAVLTree<Key, Value>::end() const
+{
+    return iterator(this, NIL);
+}
+
+template<typename Key, typename Value>
+typename IndexAVLTree<Key, Value>::iterator IndexAVLTree<Key, Value>::find(const Key& key) const
+{
+    return iterator(this, internalFind(key));
+}
+
+template<typename Key, typename Value>
+Value& IndexAVLTree<Key, Value>::operator[](const Key& key)
+{
+    Index curr = internalFind(key);
+    if(curr == NIL) throw std::out_of_range("Invalid key");
+    return values_[curr];
+}
+
+template<typename Key, typename Value>
+Value const & IndexAVLTree<Key, Value>::operator[](const Key& key) const
+{
+    Index curr = internalFind(key);
+    if(curr == NIL) throw std::out_of_range("Invalid key");
+    return values_[curr];
+}
+
+template<typename Key, typename Value>
+typename IndexAVLTree<Key, Value>::Index IndexAVLTree<Key, Value>::internalFind(const Key& key) const
+{
+    Index curr = root_;
+    while(curr != NIL) {
+        if(key < keys_[curr]) curr = links_[curr].left;
+        else if(keys_[curr] < key) curr = links_[curr].right;
+        else return curr;
+    }
+    return NIL;
+}
+
+template<typename Key, typename Value>
+typename IndexAVLTree<Key, Value>::Index IndexAVLTree<Key, Value>::successor(Index n) const
+{
+    if(links_[n].right != NIL) {
+        n = links_[n].right;
+        while(links_[n].left != NIL) n = links_[n].left;
+        return n;
+    }
+    Index parent = links_[n].parent;
+    while(parent != NIL && links_[parent].right == n) {
+        n = parent;
+        parent = links_[parent].parent;
+    }
+    return parent;
+}
+
+// The link in parent (or root_) that currently holds child.
+template<typename Key, typename Value>
+typename IndexAVLTree<Key, Value>::Index& IndexAVLTree<Key, Value>::childRef(Index parent, Index child)
+{
+    if(parent == NIL) return root_;
+    return links_[parent].left == child ? links_[parent].left : links_[parent].right;
+}
+
+/**
+* Rotates x left (or right) and hooks the lifted child into x's old place.
+* Returns the new subtree root; balances are left to the caller.
+*/
+template<typename Key, typename Value>
+typename IndexAVLTree<Key, Value>::Index IndexAVLTree<Key, Value>::rotate(Index x, bool left)
+{
+    Index p = links_[x].parent;
+    Index y, beta;
+    if(left) {
+        y = links_[x].right;
+        beta = links_[y].left;
+        links_[x].right = beta;
+        links_[y].left = x;
+    }
+    else {
+        y = links_[x].left;
+        beta = links_[y].right;
+        links_[x].left = beta;
+        links_[y].right = x;
+    }
+    if(beta != NIL) links_[beta].parent = x;
+    childRef(p, x) = y;
+    links_[y].parent = p;
+    links_[x].parent = y;
+    return y;
+}
+
+/**
+* Restores balance at x, whose left (tallLeft) or right side is two levels
+* taller than the other. Returns the new subtree root.
+*/
+template<typename Key, typename Value>
+typename IndexAVLTree<Key, Value>::Index IndexAVLTree<Key, Value>::fixup(Index x, bool tallLeft)
+{
+    const int8_t heavy = tallLeft ? 1 : -1;
+    Index y = tallLeft ? links_[x].left : links_[x].right;
+
+    if(balance_[y] != -heavy) {
+        Index top = rotate(x, !tallLeft);
+        if(balance_[y] == 0) {
+            balance_[x] = heavy;
+            balance_[y] = -heavy;
+        }
+        else {
+            balance_[x] = 0;
+            balance_[y] = 0;
+        }
+        return top;
+    }
+
+    Index z = tallLeft ? links_[y].right : links_[y].left;
+    int8_t zb = balance_[z];
+    rotate(y, tallLeft);
+    Index top = rotate(x, !tallLeft);
+    balance_[x] = (zb == heavy) ? -heavy : 0;
+    balance_[y] = (zb == -heavy) ? heavy : 0;
+    balance_[z] = 0;
+    return top;
+}
+
+template<typename Key, typename Value>
+void IndexAVLTree<Key, Value>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    const Key& key = keyValuePair.first;
+
+    Index parent = NIL;
+    Index curr = root_;
+    bool goLeft = false;
+    while(curr != NIL) {
+        parent = curr;
+        if(key < keys_[curr]) {
+            curr = links_[curr].left;
+            goLeft = true;
+        }
+        else if(keys_[curr] < key) {
+            curr = links_[curr].right;
+            goLeft = false;
+        }
+        else {
+            values_[curr] = keyValuePair.second;
+            return;
+        }
+    }
+
+    if(keys_.size() >= NIL) throw std::length_error("IndexAVLTree is full");
+    Index node = static_cast<Index>(keys_.size());
+    Links links = { NIL, NIL, parent };
+    keys_.push_back(key);
+    values_.push_back(keyValuePair.second);
+    links_.push_back(links);
+    balance_.push_back(0);
+
+    if(parent == NIL) {
+        root_ = node;
+        return;
+    }
+    if(goLeft) links_[parent].left = node;
+    else links_[parent].right = node;
+
+    // retrace: the subtree rooted at child grew by one
+    Index child = node;
+    while(parent != NIL) {
+        bool fromLeft = (links_[parent].left == child);
+        int8_t b = balance_[parent] + (fromLeft ? 1 : -1);
+        if(b == 0) {
+            balance_[parent] = 0;
+            return;
+        }
+        if(b == 1 || b == -1) {
+            balance_[parent] = b;
+            child = parent;
+            parent = links_[parent].parent;
+            continue;
+        }
+        fixup(parent, fromLeft);
+        return;
+    }
+}
+
+template<typename Key, typename Value>
+void IndexAVLTree<Key, Value>::remove(const Key& key)
+{
+    Index node = internalFind(key);
+    if(node == NIL) return;
+
+    // two children: trade contents with the predecessor and remove that slot
+    if(links_[node].left != NIL && links_[node].right != NIL) {
+        Index pred = links_[node].left;
+        while(links_[pred].right != NIL) pred = links_[pred].right;
+        std::swap(keys_[node], keys_[pred]);
+        std::swap(values_[node], values_[pred]);
+        node = pred;
+    }
+
+    Index parent = links_[node].parent;
+    Index child = links_[node].left != NIL ? links_[node].left : links_[node].right;
+    bool fromLeft = (parent != NIL && links_[parent].left == node);
+    if(child != NIL) links_[child].parent = parent;
+    childRef(parent, node) = child;
+
+    // retrace: the subtree on side fromLeft of parent shrank by one
+    while(parent != NIL) {
+        int8_t b = balance_[parent] + (fromLeft ? -1 : 1);
+        Index top = parent;
+        if(b == 1 || b == -1) {
+            balance_[parent] = b;
+            break;
+        }
+        if(b == 0) {
+            balance_[parent] = 0;
+        }
+        else {
+            top = fixup(parent, !fromLeft);
+            if(balance_[top] != 0) break;
+        }
+        Index above = links_[top].parent;
+        fromLeft = (above != NIL && links_[above].left == top);
+        parent = above;
+    }
+
+    releaseSlot(node);
+}
+
+/**
+* Moves the last slot into the (already unlinked) slot n so the arrays stay
+* dense, then drops the last slot.
+*/
+template<typename Key, typename Value>
+void IndexAVLTree<Key, Value>::releaseSlot(Index n)
+{
+    Index last = static_cast<Index>(keys_.size() - 1);
+    if(n != last) {
+        std::swap(keys_[n], keys_[last]);
+        std::swap(values_[n], values_[last]);
+        links_[n] = links_[last];
+        balance_[n] = balance_[last];
+
+        childRef(links_[n].parent, last) = n;
+        if(links_[n].left != NIL) links_[links_[n].left].parent = n;
+        if(links_[n].right != NIL) links_[links_[n].right].parent = n;
+    }
+    keys_.pop_back();
+    values_.pop_back();
+    links_.pop_back();
+    balance_.pop_back();
+}
+
+template<typename Key, typename Value>
+int IndexAVLTree<Key, Value>::heightOrNegOne(Index n) const
+{
+    if(n == NIL) return 0;
+
+    int lh = heightOrNegOne(links_[n].left);
+    if(lh == -1) return -1;
+
+    int rh = heightOrNegOne(links_[n].right);
+    if(rh == -1) return -1;
+
+    if(lh - rh > 1 || rh - lh > 1) return -1;
+    if(balance_[n] != lh - rh) return -1;
+
+    return (lh > rh ? lh : rh) + 1;
+}
+
+/*
+  ---------------------------------------------
+  End implementations for the IndexAVLTree class.
+  ---------------------------------------------
+*/
+
+#endif
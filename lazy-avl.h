@@ -0,0 +1,592 @@
+#ifndef LAZY_AVL_H
+#define LAZY_AVL_H
+
+#include <iostream>
+#include <exception>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "avlbst.h"
+
+/**
+* An AVLNode that can be marked dead (a tombstone) instead of being unlinked.
+*/
+template <typename Key, typename Value>
+class TombstoneAVLNode : public AVLNode<Key, Value>
+{
+public:
+    TombstoneAVLNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent);
+    virtual ~TombstoneAVLNode();
+
+    bool isDead() const;
+    void setDead(bool dead);
+
+    virtual TombstoneAVLNode<Key, Value>* clone(Node<Key, Value>* parent) const override;
+    virtual size_t footprint() const override;
+
+protected:
+    bool dead_;
+};
+
+/*
+  ----------------------------------------------------
+  Begin implementations for the TombstoneAVLNode class.
+  ----------------------------------------------------
+*/
+
+template<class Key, class Value>
+TombstoneAVLNode<Key, Value>::TombstoneAVLNode(const Key& key, const Value& value,
+                                               AVLNode<Key, Value>* parent) :
+    AVLNode<Key, Value>(key, value, parent), dead_(false)
+{
+
+}
+
+template<class Key, class Value>
+TombstoneAVLNode<Key, Value>::~TombstoneAVLNode()
+{
+
+}
+
+template<class Key, class Value>
+bool TombstoneAVLNode<Key, Value>::isDead() const
+{
+    return dead_;
+}
+
+template<class Key, class Value>
+void TombstoneAVLNode<Key, Value>::setDead(bool dead)
+{
+    dead_ = dead;
+}
+
+template<class Key, class Value>
+TombstoneAVLNode<Key, Value>* TombstoneAVLNode<Key, Value>::clone(Node<Key, Value>* parent) const
+{
+    TombstoneAVLNode<Key, Value>* node =
+        new TombstoneAVLNode<Key, Value>(this->getKey(), this->getValue(),
+                                         static_cast<AVLNode<Key, Value>*>(parent));
+    node->setBalance(this->getBalance());
+    node->dead_ = dead_;
+    return node;
+}
+
+template<class Key, class Value>
+size_t TombstoneAVLNode<Key, Value>::footprint() const
+{
+    return sizeof(*this);
+}
+
+/*
+  --------------------------------------------------
+  End implementations for the TombstoneAVLNode class.
+  --------------------------------------------------
+*/
+
+/**
+* An AVLTree with lazy deletion: remove() only marks the node dead, so a
+* burst of removals costs one O(log n) search each and no rotations.
+* Lookups and iteration skip the dead nodes, and inserting a removed key
+* again simply revives its node. Once more than maxDeadFraction of the nodes
+* are dead, compact() frees them and relinks the live nodes into a perfectly
+* balanced tree in one linear pass; live nodes are never moved, so iterators
+* to them stay valid.
+*
+* pop_front() and pop_back() unlink for real (together with any dead nodes
+* at that end), which keeps repeated pops from piling up a dead prefix.
+*
+* The base classes' size(), iteration and lookups would count and return
+* the dead nodes, so AVLTree is a protected base: a LazyAVLTree cannot be
+* used through a base reference, and the parts of the base interface that
+* are safe are made public below. analyze() and memory_usage() describe
+* the nodes held, dead ones included.
+*/
+template <class Key, class Value>
+class LazyAVLTree : protected AVLTree<Key, Value>
+{
+public:
+    /**
+    * Iterator over the live items only.
+    */
+    class iterator : public BinarySearchTree<Key, Value>::iterator
+    {
+    public:
+        iterator();
+        iterator& operator++();
+
+    protected:
+        friend class LazyAVLTree<Key, Value>;
+        explicit iterator(Node<Key, Value>* ptr);
+        void skipDead();
+    };
+
+    explicit LazyAVLTree(double maxDeadFraction = 0.5);
+    LazyAVLTree(const LazyAVLTree& other);
+    LazyAVLTree(LazyAVLTree&& other);
+    LazyAVLTree& operator=(const LazyAVLTree& other);
+    LazyAVLTree& operator=(LazyAVLTree&& other);
+    void swap(LazyAVLTree& other);
+
+    virtual void insert(const std::pair<const Key, Value> &new_item);
+    iterator insert(iterator hint, const std::pair<const Key, Value> &new_item);
+    void append_back(const std::pair<const Key, Value> &new_item);
+    virtual void remove(const Key& key);
+    virtual void clear();
+    void compact();
+
+    size_t size() const;
+    size_t tombstones() const;
+    bool empty() const;
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    void find_many(const std::vector<Key>& keys, std::vector<iterator>& out) const;
+    Value& operator[](const Key& key);
+    Value const & operator[](const Key& key) const;
+    std::pair<const Key, Value>& front() const;
+    std::pair<const Key, Value>& back() const;
+    void pop_front();
+    void pop_back();
+    iterator erase(iterator pos);
+    iterator erase(iterator first, iterator last);
+
+    // Saving compacts the tree first, so the snapshot holds live items only
+    void save(std::ostream& os);
+    void save(const std::string& path);
+    virtual void load(std::istream& is);
+    void load(const std::string& path);
+
+    using AVLTree<Key, Value>::begin_bulk;
+    using AVLTree<Key, Value>::end_bulk;
+    using AVLTree<Key, Value>::rebalance;
+    using AVLTree<Key, Value>::isBalanced;
+    using AVLTree<Key, Value>::analyze;
+    using AVLTree<Key, Value>::memory_usage;
+    using AVLTree<Key, Value>::print;
+
+protected:
+    typedef TombstoneAVLNode<Key, Value> TombNode;
+
+    virtual AVLNode<Key,Value>* createNode(const Key& key, const Value& value, AVLNode<Key,Value>* parent);
+    static bool isDead(Node<Key, Value>* node);
+    Node<Key, Value>* liveNode(const Key& key) const;
+    void revive(AVLNode<Key, Value>* node);
+    void markDead(Node<Key, Value>* node);
+    void removeDeadEnds();
+
+    double maxDeadFraction_;
+    size_t live_;
+    size_t dead_;
+};
+
+/*
+--------------------------------------------------------
+Begin implementations for the LazyAVLTree::iterator class.
+--------------------------------------------------------
+*/
+
+template<class Key, class Value>
+LazyAVLTree<Key, Value>::iterator::iterator() :
+    BinarySearchTree<Key, Value>::iterator()
+{
+
+}
+
+// Starts at ptr, or at the next live item if ptr is dead
+template<class Key, class Value>
+LazyAVLTree<Key, Value>::iterator::iterator(Node<Key, Value>* ptr) :
+    BinarySearchTree<Key, Value>::iterator()
+{
+    this->current_ = ptr;
+    skipDead();
+}
+
+template<class Key, class Value>
+typename LazyAVLTree<Key, Value>::iterator&
+LazyAVLTree<Key, Value>::iterator::operator++()
+{
+    BinarySearchTree<Key, Value>::iterator::operator++();
+    skipDead();
+    return *this;
+}
+
+template<class Key, class Value>
+void LazyAVLTree<Key, Value>::iterator::skipDead()
+{
+    while(LazyAVLTree<Key, Value>::isDead(this->current_)) {
+        BinarySearchTree<Key, Value>::iterator::operator++();
+    }
+}
+
+/*
+------------------------------------------------------
+End implementations for the LazyAVLTree::iterator class.
+------------------------------------------------------
+*/
+
+/*
+  -----------------------------------------------
+  Begin implementations for the LazyAVLTree class.
+  -----------------------------------------------
+*/
+
+template<class Key, class Value>
+LazyAVLTree<Key, Value>::LazyAVLTree(double maxDeadFraction) :
+    AVLTree<Key, Value>(), maxDeadFraction_(maxDeadFraction), live_(0), dead_(0)
+{
+    if(maxDeadFraction_ <= 0.0 || maxDeadFraction_ >= 1.0) maxDeadFraction_ = 0.5;
+}
+
+template<class Key, class Value>
+LazyAVLTree<Key, Value>::LazyAVLTree(const LazyAVLTree& other) :
+    AVLTree<Key, Value>(other), maxDeadFraction_(other.maxDeadFraction_),
+    live_(other.live_), dead_(other.dead_)
+{
+}
+
+// The moved-from tree is left empty, with its counts to match
+template<class Key, class Value>
+LazyAVLTree<Key, Value>::LazyAVLTree(LazyAVLTree&& other) :
+    AVLTree<Key, Value>(std::move(other)), maxDeadFraction_(other.maxDeadFraction_),
+    live_(other.live_), dead_(other.dead_)
+{
+    other.live_ = 0;
+    other.dead_ = 0;
+}
+
+template<class Key, class Value>
+LazyAVLTree<Key, Value>& LazyAVLTree<Key, Value>::operator=(const LazyAVLTree& other)
+{
+    if(this != &other) {
+        LazyAVLTree<Key, Value> copy(other);
+        swap(copy);
+    }
+    return *this;
+}
+
+template<class Key, class Value>
+LazyAVLTree<Key, Value>& LazyAVLTree<Key, Value>::operator=(LazyAVLTree&& other)
+{
+    if(this != &other) {
+        clear();
+        swap(other);
+    }
+    return *this;
+}
+
+template<class Key, class Value>
+void LazyAVLTree<Key, Value>::swap(LazyAVLTree& other)
+{
+    AVLTree<Key, Value>::swap(other);
+    std::swap(maxDeadFraction_, other.maxDeadFraction_);
+    std::swap(live_, other.live_);
+    std::swap(dead_, other.dead_);
+}
+
+template<class Key, class Value>
+void LazyAVLTree<Key, Value>::insert(const std::pair<const Key, Value> &new_item)
+{
+    revive(this->insertFrom(NULL, new_item));
+}
+
+// A hinted insert of a removed key revives its node, like insert() does
+template<class Key, class Value>
+typename LazyAVLTree<Key, Value>::iterator
+LazyAVLTree<Key, Value>::insert(iterator hint, const std::pair<const Key, Value> &new_item)
+{
+    Node<Key, Value>* node = BinarySearchTree<Key, Value>::nodeOf(AVLTree<Key, Value>::insert(hint, new_item));
+    revive(static_cast<AVLNode<Key, Value>*>(node));
+    return iterator(node);
+}
+
+template<class Key, class Value>
+void LazyAVLTree<Key, Value>::append_back(const std::pair<const Key, Value> &new_item)
+{
+    Node<Key, Value>* last = this->getLargestNode();
+    if(last != NULL && !(last->getKey() < new_item.first)) {
+        insert(new_item);
+        return;
+    }
+    AVLTree<Key, Value>::append_back(new_item);
+}
+
+template<class Key, class Value>
+void LazyAVLTree<Key, Value>::remove(const Key& key)
+{
+    Node<Key, Value>* node = liveNode(key);
+    if(node != NULL) markDead(node);
+}
+
+template<class Key, class Value>
+void LazyAVLTree<Key, Value>::clear()
+{
+    AVLTree<Key, Value>::clear();
+    live_ = 0;
+    dead_ = 0;
+}
+
+/**
+* Frees every dead node and rebuilds the live ones into a perfectly
+* balanced tree. One in-order walk collects the nodes, and the live ones are
+* then relinked straight from that array; both steps are O(n) and no live
+* node is allocated or moved. The walk climbs through parent links of nodes
+* it has already passed, so the dead ones are freed only afterwards.
+*/
+template<class Key, class Value>
+void LazyAVLTree<Key, Value>::compact()
+{
+    if(this->root_ == NULL) return;
+
+    std::vector<Node<Key, Value>*> nodes;
+    nodes.reserve(live_ + dead_);
+    for(Node<Key, Value>* node = this->getSmallestNode(); node != NULL;
+        node = BinarySearchTree<Key, Value>::successor(node)) {
+        nodes.push_back(node);
+    }
+
+    size_t live = 0;
+    for(size_t i = 0; i < nodes.size(); ++i) {
+        if(isDead(nodes[i])) delete nodes[i];
+        else nodes[live++] = nodes[i];
+    }
+
+    nodes.resize(live);
+    this->relinkBalanced(nodes);
+    dead_ = 0;
+}
+
+template<class Key, class Value>
+size_t LazyAVLTree<Key, Value>::size() const
+{
+    return live_;
+}
+
+template<class Key, class Value>
+size_t LazyAVLTree<Key, Value>::tombstones() const
+{
+    return dead_;
+}
+
+template<class Key, class Value>
+bool LazyAVLTree<Key, Value>::empty() const
+{
+    return live_ == 0;
+}
+
+template<class Key, class Value>
+typename LazyAVLTree<Key, Value>::iterator LazyAVLTree<Key, Value>::begin() const
+{
+    return iterator(this->getSmallestNode());
+}
+
+template<class Key, class Value>
+typename LazyAVLTree<Key, Value>::iterator LazyAVLTree<Key, Value>::end() const
+{
+    return iterator(NULL);
+}
+
+template<class Key, class Value>
+typename LazyAVLTree<Key, Value>::iterator LazyAVLTree<Key, Value>::find(const Key& key) const
+{
+    return iterator(liveNode(key));
+}
+
+template<class Key, class Value>
+void LazyAVLTree<Key, Value>::find_many(const std::vector<Key>& keys, std::vector<iterator>& out) const
+{
+    std::vector<typename BinarySearchTree<Key, Value>::iterator> found;
+    BinarySearchTree<Key, Value>::find_many(keys, found);
+    out.resize(found.size());
+    for(size_t i = 0; i < found.size(); ++i) {
+        Node<Key, Value>* node = BinarySearchTree<Key, Value>::nodeOf(found[i]);
+        out[i] = iterator(isDead(node) ? NULL : node);
+    }
+}
+
+template<class Key, class Value>
+Value& LazyAVLTree<Key, Value>::operator[](const Key& key)
+{
+    Node<Key, Value>* node = liveNode(key);
+    if(node == NULL) throw std::out_of_range("Invalid key");
+    return node->getValue();
+}
+
+template<class Key, class Value>
+Value const & LazyAVLTree<Key, Value>::operator[](const Key& key) const
+{
+    Node<Key, Value>* node = liveNode(key);
+    if(node == NULL) throw std::out_of_range("Invalid key");
+    return node->getValue();
+}
+
+template<class Key, class Value>
+std::pair<const Key, Value>& LazyAVLTree<Key, Value>::front() const
+{
+    iterator it = begin();
+    if(it == end()) throw std::out_of_range("Empty tree");
+    return *it;
+}
+
+template<class Key, class Value>
+std::pair<const Key, Value>& LazyAVLTree<Key, Value>::back() const
+{
+    Node<Key, Value>* node = this->getLargestNode();
+    while(isDead(node)) node = BinarySearchTree<Key, Value>::predecessor(node);
+    if(node == NULL) throw std::out_of_range("Empty tree");
+    return node->getItem();
+}
+
+template<class Key, class Value>
+void LazyAVLTree<Key, Value>::pop_front()
+{
+    removeDeadEnds();
+    if(this->getSmallestNode() == NULL) return;
+    this->removeNode(this->getSmallestNode(), false);
+    --live_;
+    removeDeadEnds();
+}
+
+template<class Key, class Value>
+void LazyAVLTree<Key, Value>::pop_back()
+{
+    removeDeadEnds();
+    if(this->getLargestNode() == NULL) return;
+    this->removeNode(this->getLargestNode(), false);
+    --live_;
+    removeDeadEnds();
+}
+
+template<class Key, class Value>
+typename LazyAVLTree<Key, Value>::iterator LazyAVLTree<Key, Value>::erase(iterator pos)
+{
+    Node<Key, Value>* node = BinarySearchTree<Key, Value>::nodeOf(pos);
+    if(node == NULL) return end();
+    iterator next(BinarySearchTree<Key, Value>::successor(node));
+    markDead(node);
+    return next;
+}
+
+template<class Key, class Value>
+typename LazyAVLTree<Key, Value>::iterator LazyAVLTree<Key, Value>::erase(iterator first, iterator last)
+{
+    if(first == begin() && last == end()) {
+        clear();
+        return end();
+    }
+    while(first != last) {
+        first = erase(first);
+    }
+    return last;
+}
+
+template<class Key, class Value>
+void LazyAVLTree<Key, Value>::save(std::ostream& os)
+{
+    compact();
+    AVLTree<Key, Value>::save(os);
+}
+
+template<class Key, class Value>
+void LazyAVLTree<Key, Value>::save(const std::string& path)
+{
+    compact();
+    AVLTree<Key, Value>::save(path);
+}
+
+/*
+ * The nodes built while loading are counted by createNode, so the counts
+ * are restored if the load fails and recounted once it succeeds.
+ */
+template<class Key, class Value>
+void LazyAVLTree<Key, Value>::load(std::istream& is)
+{
+    size_t live = live_;
+    size_t dead = dead_;
+    try {
+        AVLTree<Key, Value>::load(is);
+    }
+    catch(...) {
+        live_ = live;
+        dead_ = dead;
+        throw;
+    }
+    live_ = 0;
+    dead_ = 0;
+    for(iterator it = begin(); it != end(); ++it) ++live_;
+}
+
+template<class Key, class Value>
+void LazyAVLTree<Key, Value>::load(const std::string& path)
+{
+    std::ifstream ifile(path.c_str(), std::ios::binary);
+    if(!ifile) throw std::runtime_error("cannot open " + path);
+    load(ifile);
+}
+
+template<class Key, class Value>
+AVLNode<Key,Value>* LazyAVLTree<Key, Value>::createNode(const Key& key, const Value& value,
+                                                        AVLNode<Key,Value>* parent)
+{
+    TombNode* node = new TombNode(key, value, parent);
+    ++live_;
+    return node;
+}
+
+template<class Key, class Value>
+bool LazyAVLTree<Key, Value>::isDead(Node<Key, Value>* node)
+{
+    return node != NULL && static_cast<TombNode*>(node)->isDead();
+}
+
+template<class Key, class Value>
+Node<Key, Value>* LazyAVLTree<Key, Value>::liveNode(const Key& key) const
+{
+    Node<Key, Value>* node = this->internalFind(key);
+    return isDead(node) ? NULL : node;
+}
+
+// Helper: a removed key was inserted again (new nodes are counted in createNode)
+template<class Key, class Value>
+void LazyAVLTree<Key, Value>::revive(AVLNode<Key, Value>* node)
+{
+    TombNode* tomb = static_cast<TombNode*>(node);
+    if(tomb->isDead()) {
+        tomb->setDead(false);
+        --dead_;
+        ++live_;
+    }
+}
+
+template<class Key, class Value>
+void LazyAVLTree<Key, Value>::markDead(Node<Key, Value>* node)
+{
+    static_cast<TombNode*>(node)->setDead(true);
+    --live_;
+    ++dead_;
+    if(static_cast<double>(dead_) > maxDeadFraction_ * static_cast<double>(live_ + dead_)) {
+        compact();
+    }
+}
+
+// Helper: unlinks the dead nodes at either end of the tree
+template<class Key, class Value>
+void LazyAVLTree<Key, Value>::removeDeadEnds()
+{
+    while(isDead(this->getSmallestNode())) {
+        this->removeNode(this->getSmallestNode(), false);
+        --dead_;
+    }
+    while(isDead(this->getLargestNode())) {
+        this->removeNode(this->getLargestNode(), false);
+        --dead_;
+    }
+}
+
+/*
+  ---------------------------------------------
+  End implementations for the LazyAVLTree class.
+  ---------------------------------------------
+*/
+
+#endif
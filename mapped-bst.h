@@ -0,0 +1,448 @@
+#ifndef MAPPED_BST_H
+#define MAPPED_BST_H
+
+#include <iostream>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "bst.h"
+
+/**
+* Read-only, memory mappable search tree file.
+*
+* writeMappedTree() exports a BinarySearchTree (or AVLTree) into a file that
+* MappedTree can query in place: no deserialization, no allocation, and every
+* process mapping the same file shares the same page cache.
+*
+* File layout (native endianness):
+*   MappedHeader, padded to 64 bytes
+*   count fixed size MappedRecord entries
+*
+* The records form a perfectly balanced search tree laid out in level order,
+* so the top levels of every search share the first few pages. Links are
+* byte offsets relative to the record that holds them (0 means none), so the
+* file is position independent and can be mapped at any address. A child
+* always comes after its parent in level order, so child links are positive.
+*/
+struct MappedHeader
+{
+    char magic[4];          // "BSTM"
+    uint16_t version;
+    uint16_t reserved;
+    uint32_t keySize;
+    uint32_t valueSize;
+    uint32_t recordSize;
+    uint32_t headerSize;
+    uint64_t count;
+    uint64_t rootOffset;    // absolute offset of the root record, 0 if empty
+    uint64_t firstOffset;   // absolute offset of the smallest record, 0 if empty
+};
+
+static const uint16_t MAPPED_VERSION = 1;
+static const uint32_t MAPPED_HEADER_SIZE = 64;
+
+template <typename Key, typename Value>
+struct MappedRecord
+{
+    int64_t left;           // relative offsets, 0 means NULL
+    int64_t right;
+    int64_t next;           // in-order successor
+    // named like std::pair so records read like the items of a map
+    Key first;
+    Value second;
+};
+
+/**
+* Writes the contents of tree to path in the MappedTree format.
+* Key and Value must be trivially copyable (fixed width).
+*/
+template <typename Key, typename Value>
+void writeMappedTree(const BinarySearchTree<Key, Value>& tree, const std::string& path)
+{
+    static_assert(std::is_trivially_copyable<Key>::value, "mapped keys must be trivially copyable");
+    static_assert(std::is_trivially_copyable<Value>::value, "mapped values must be trivially copyable");
+    typedef MappedRecord<Key, Value> Record;
+
+    std::vector<const std::pair<const Key, Value>*> items;
+    for(typename BinarySearchTree<Key, Value>::iterator it = tree.begin(); it != tree.end(); ++it) {
+        items.push_back(&(*it));
+    }
+    const size_t n = items.size();
+
+    // assign level order positions to the midpoints of the sorted ranges
+    std::vector<std::pair<size_t, size_t> > ranges;   // [lo, hi) per position
+    std::vector<size_t> sortedAt;                     // position -> sorted index
+    std::vector<size_t> posOf(n);                     // sorted index -> position
+    std::vector<int64_t> leftPos, rightPos;
+    if(n > 0) ranges.push_back(std::make_pair(size_t(0), n));
+    for(size_t pos = 0; pos < ranges.size(); ++pos) {
+        size_t lo = ranges[pos].first, hi = ranges[pos].second;
+        size_t mid = lo + (hi - lo) / 2;
+        sortedAt.push_back(mid);
+        posOf[mid] = pos;
+        leftPos.push_back(-1);
+        rightPos.push_back(-1);
+        if(lo < mid) {
+            leftPos[pos] = static_cast<int64_t>(ranges.size());
+            ranges.push_back(std::make_pair(lo, mid));
+        }
+        if(mid + 1 < hi) {
+            rightPos[pos] = static_cast<int64_t>(ranges.size());
+            ranges.push_back(std::make_pair(mid + 1, hi));
+        }
+    }
+
+    MappedHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, "BSTM", 4);
+    header.version = MAPPED_VERSION;
+    header.keySize = sizeof(Key);
+    header.valueSize = sizeof(Value);
+    header.recordSize = sizeof(Record);
+    header.headerSize = MAPPED_HEADER_SIZE;
+    header.count = n;
+    header.rootOffset = n > 0 ? MAPPED_HEADER_SIZE : 0;
+    header.firstOffset = n > 0 ? MAPPED_HEADER_SIZE + posOf[0] * sizeof(Record) : 0;
+
+    std::ofstream ofile(path.c_str(), std::ios::binary | std::ios::trunc);
+    if(!ofile) throw std::runtime_error("cannot open " + path);
+
+    char headerBytes[MAPPED_HEADER_SIZE];
+    std::memset(headerBytes, 0, sizeof(headerBytes));
+    std::memcpy(headerBytes, &header, sizeof(header));
+    ofile.write(headerBytes, sizeof(headerBytes));
+
+    const int64_t rs = static_cast<int64_t>(sizeof(Record));
+    for(size_t pos = 0; pos < sortedAt.size(); ++pos) {
+        Record rec;
+        std::memset(&rec, 0, sizeof(rec));
+        int64_t self = static_cast<int64_t>(pos);
+        size_t k = sortedAt[pos];
+        rec.left = leftPos[pos] < 0 ? 0 : (leftPos[pos] - self) * rs;
+        rec.right = rightPos[pos] < 0 ? 0 : (rightPos[pos] - self) * rs;
+        rec.next = (k + 1 < n) ? (static_cast<int64_t>(posOf[k + 1]) - self) * rs : 0;
+        std::memcpy(&rec.first, &items[k]->first, sizeof(Key));
+        std::memcpy(&rec.second, &items[k]->second, sizeof(Value));
+        ofile.write(reinterpret_cast<const char*>(&rec), sizeof(rec));
+    }
+
+    ofile.flush();
+    if(!ofile) throw std::runtime_error("write failed: " + path);
+}
+
+/**
+* Zero-copy reader over a file produced by writeMappedTree(). Iterators
+* yield the records, whose first and second are the key and the value.
+*
+* The file is not trusted: validate() checks the header, and every link is
+* checked against the record area before it is followed, so a corrupt or
+* hostile file makes an operation throw std::runtime_error instead of
+* reading outside the mapping. Child links must point forward, so a search
+* always ends; a bad successor link can still make an iteration loop.
+*/
+template <typename Key, typename Value>
+class MappedTree
+{
+public:
+    typedef MappedRecord<Key, Value> Record;
+
+    // Maps the file read-only. Throws std::runtime_error on failure.
+    explicit MappedTree(const std::string& path);
+    // Uses a buffer that is already in memory (owned by the caller).
+    MappedTree(const void* data, size_t length);
+    ~MappedTree();
+
+    class iterator
+    {
+    public:
+        iterator();
+
+        const Record& operator*() const;
+        const Record* operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+
+    protected:
+        friend class MappedTree<Key, Value>;
+        iterator(const MappedTree<Key, Value>* tree, const Record* ptr);
+        const MappedTree<Key, Value>* tree_;
+        const Record* current_;
+    };
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    // first record whose key is not less than key
+    iterator lower_bound(const Key& key) const;
+    const Value& operator[](const Key& key) const;
+    size_t size() const;
+    bool empty() const;
+
+protected:
+    const Record* follow(const Record* r, int64_t offset) const;
+    const Record* child(const Record* r, int64_t offset) const;
+    const Record* at(uint64_t offset) const;
+    void validate();
+
+private:
+    MappedTree(const MappedTree&);
+    MappedTree& operator=(const MappedTree&);
+
+    const char* base_;
+    size_t length_;
+    bool owned_;
+    const MappedHeader* header_;
+    // end of the last record; every link must land in [header, recordsEnd_)
+    uint64_t recordsEnd_;
+};
+
+/*
+  -----------------------------------------------
+  Begin implementations for the MappedTree class.
+  -----------------------------------------------
+*/
+
+template<typename Key, typename Value>
+MappedTree<Key, Value>::iterator::iterator() : tree_(NULL), current_(NULL)
+{
+
+}
+
+template<typename Key, typename Value>
+MappedTree<Key, Value>::iterator::iterator(const MappedTree<Key, Value>* tree, const Record* ptr) :
+    tree_(tree), current_(ptr)
+{
+
+}
+
+template<typename Key, typename Value>
+const typename MappedTree<Key, Value>::Record&
+MappedTree<Key, Value>::iterator::operator*() const
+{
+    return *current_;
+}
+
+template<typename Key, typename Value>
+const typename MappedTree<Key, Value>::Record*
+MappedTree<Key, Value>::iterator::operator->() const
+{
+    return current_;
+}
+
+template<typename Key, typename Value>
+bool MappedTree<Key, Value>::iterator::operator==(const iterator& rhs) const
+{
+    return current_ == rhs.current_;
+}
+
+template<typename Key, typename Value>
+bool MappedTree<Key, Value>::iterator::operator!=(const iterator& rhs) const
+{
+    return current_ != rhs.current_;
+}
+
+template<typename Key, typename Value>
+typename MappedTree<Key, Value>::iterator&
+MappedTree<Key, Value>::iterator::operator++()
+{
+    if(current_ != NULL) {
+        current_ = tree_->follow(current_, current_->next);
+    }
+    return *this;
+}
+
+template<typename Key, typename Value>
+MappedTree<Key, Value>::MappedTree(const std::string& path) :
+    base_(NULL), length_(0), owned_(true), header_(NULL), recordsEnd_(0)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0) throw std::runtime_error("cannot open " + path);
+
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(MAPPED_HEADER_SIZE)) {
+        close(fd);
+        throw std::runtime_error("not a mapped tree: " + path);
+    }
+    length_ = static_cast<size_t>(st.st_size);
+
+    void* p = mmap(NULL, length_, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(p == MAP_FAILED) throw std::runtime_error("mmap failed: " + path);
+    base_ = static_cast<const char*>(p);
+
+    try {
+        validate();
+    }
+    catch(...) {
+        munmap(const_cast<char*>(base_), length_);
+        throw;
+    }
+}
+
+template<typename Key, typename Value>
+MappedTree<Key, Value>::MappedTree(const void* data, size_t length) :
+    base_(static_cast<const char*>(data)), length_(length), owned_(false), header_(NULL), recordsEnd_(0)
+{
+    validate();
+}
+
+template<typename Key, typename Value>
+MappedTree<Key, Value>::~MappedTree()
+{
+    if(owned_ && base_ != NULL) {
+        munmap(const_cast<char*>(base_), length_);
+    }
+}
+
+/**
+* Checks the header against this instantiation and the file size. The
+* links inside the records are checked as they are followed (see at()).
+*/
+template<typename Key, typename Value>
+void MappedTree<Key, Value>::validate()
+{
+    if(length_ < MAPPED_HEADER_SIZE) throw std::runtime_error("not a mapped tree");
+    header_ = reinterpret_cast<const MappedHeader*>(base_);
+    if(std::memcmp(header_->magic, "BSTM", 4) != 0) {
+        throw std::runtime_error("not a mapped tree");
+    }
+    if(header_->version != MAPPED_VERSION || header_->headerSize != MAPPED_HEADER_SIZE) {
+        throw std::runtime_error("unsupported mapped tree version");
+    }
+    if(header_->keySize != sizeof(Key) || header_->valueSize != sizeof(Value) ||
+       header_->recordSize != sizeof(Record)) {
+        throw std::runtime_error("mapped tree key/value types do not match");
+    }
+    if(header_->count > (length_ - MAPPED_HEADER_SIZE) / sizeof(Record)) {
+        throw std::runtime_error("mapped tree is truncated");
+    }
+    recordsEnd_ = MAPPED_HEADER_SIZE + header_->count * sizeof(Record);
+    if((header_->count == 0) != (header_->rootOffset == 0) ||
+       (header_->count == 0) != (header_->firstOffset == 0)) {
+        throw std::runtime_error("mapped tree is corrupt");
+    }
+    at(header_->rootOffset);
+    at(header_->firstOffset);
+}
+
+// ----- Helper: the record offset bytes away from r, or NULL for 0 -----
+template<typename Key, typename Value>
+const typename MappedTree<Key, Value>::Record*
+MappedTree<Key, Value>::follow(const Record* r, int64_t offset) const
+{
+    if(offset == 0) return NULL;
+    // unsigned wrap around turns a link before the file into a huge offset
+    uint64_t from = static_cast<uint64_t>(reinterpret_cast<const char*>(r) - base_);
+    return at(from + static_cast<uint64_t>(offset));
+}
+
+// ----- Helper: like follow(), for a child link, which must point forward -----
+template<typename Key, typename Value>
+const typename MappedTree<Key, Value>::Record*
+MappedTree<Key, Value>::child(const Record* r, int64_t offset) const
+{
+    if(offset < 0) throw std::runtime_error("mapped tree is corrupt");
+    return follow(r, offset);
+}
+
+// ----- Helper: the record at an absolute offset, which must be a record boundary -----
+template<typename Key, typename Value>
+const typename MappedTree<Key, Value>::Record*
+MappedTree<Key, Value>::at(uint64_t offset) const
+{
+    if(offset == 0) return NULL;
+    if(offset < MAPPED_HEADER_SIZE || offset >= recordsEnd_ ||
+       (offset - MAPPED_HEADER_SIZE) % sizeof(Record) != 0) {
+        throw std::runtime_error("mapped tree is corrupt");
+    }
+    return reinterpret_cast<const Record*>(base_ + offset);
+}
+
+template<typename Key, typename Value>
+typename MappedTree<Key, Value>::iterator MappedTree<Key, Value>::begin() const
+{
+    return iterator(this, at(header_->firstOffset));
+}
+
+template<typename Key, typename Value>
+typename MappedTree<Key, Value>::iterator MappedTree<Key, Value>::end() const
+{
+    return iterator(this, NULL);
+}
+
+template<typename Key, typename Value>
+typename MappedTree<Key, Value>::iterator MappedTree<Key, Value>::find(const Key& key) const
+{
+    const Record* curr = at(header_->rootOffset);
+    while(curr != NULL) {
+        if(key < curr->first) {
+            curr = child(curr, curr->left);
+        }
+        else if(curr->first < key) {
+            curr = child(curr, curr->right);
+        }
+        else {
+            return iterator(this, curr);
+        }
+    }
+    return end();
+}
+
+template<typename Key, typename Value>
+typename MappedTree<Key, Value>::iterator MappedTree<Key, Value>::lower_bound(const Key& key) const
+{
+    const Record* curr = at(header_->rootOffset);
+    const Record* best = NULL;
+    while(curr != NULL) {
+        if(curr->first < key) {
+            curr = child(curr, curr->right);
+        }
+        else {
+            best = curr;
+            curr = child(curr, curr->left);
+        }
+    }
+    return iterator(this, best);
+}
+
+template<typename Key, typename Value>
+const Value& MappedTree<Key, Value>::operator[](const Key& key) const
+{
+    iterator it = find(key);
+    if(it == end()) throw std::out_of_range("Invalid key");
+    return it->second;
+}
+
+template<typename Key, typename Value>
+size_t MappedTree<Key, Value>::size() const
+{
+    return static_cast<size_t>(header_->count);
+}
+
+template<typename Key, typename Value>
+bool MappedTree<Key, Value>::empty() const
+{
+    return header_->count == 0;
+}
+
+/*
+  ---------------------------------------------
+  End implementations for the MappedTree class.
+  ---------------------------------------------
+*/
+
+#endif
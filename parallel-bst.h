@@ -0,0 +1,418 @@
+#ifndef PARALLEL_BST_H
+#define PARALLEL_BST_H
+
+#include <iostream>
+#include <exception>
+#include <cstdlib>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "bst.h"
+
+/**
+* Parallel traversals over any BinarySearchTree (AVLTree, RedBlackTree, ...):
+*
+*   parallel_for_each(tree, f)            f(item) on every item
+*   parallel_transform_values(tree, f)    item.second = f(key, value)
+*   parallel_reduce(tree, init, map, combine)
+*   parallel_reduce_ordered(tree, init, map, combine)
+*
+* All of them take the number of threads as an optional last argument;
+* 0 uses std::thread::hardware_concurrency(). The calling thread is one of
+* the workers. f, map and combine run concurrently, so they must not touch
+* shared state without their own locking, and the tree must not be modified
+* by anyone else until the call returns. If one of them throws, the workers
+* stop early and the first exception is rethrown on the calling thread.
+*
+* The unordered functions visit the nodes in no particular order. init must
+* be an identity for combine, and combine must be associative and
+* commutative. parallel_reduce_ordered() only needs combine to be
+* associative: it always combines the smaller keys on the left and folds
+* init in exactly once, at the far left, so the result is the same as a
+* sequential fold of the items in key order starting from init.
+*
+* A LazyAVLTree is not accepted: it keeps its removed items in the tree as
+* tombstones, which these functions would visit too.
+*/
+template<class Key, class Value, class Func>
+void parallel_for_each(BinarySearchTree<Key, Value>& tree, Func f, unsigned threads = 0);
+
+template<class Key, class Value, class Func>
+void parallel_transform_values(BinarySearchTree<Key, Value>& tree, Func f, unsigned threads = 0);
+
+template<class Key, class Value, class T, class Map, class Combine>
+T parallel_reduce(const BinarySearchTree<Key, Value>& tree, T init, Map map, Combine combine,
+                  unsigned threads = 0);
+
+template<class Key, class Value, class T, class Map, class Combine>
+T parallel_reduce_ordered(const BinarySearchTree<Key, Value>& tree, T init, Map map, Combine combine,
+                          unsigned threads = 0);
+
+/**
+* Splits a tree into subtree tasks for a pool of threads.
+*
+* Every worker walks its current subtree depth first with a private stack.
+* Whenever its public deque is empty, it moves the oldest entry of that
+* stack, which is the highest and so usually the largest pending subtree,
+* to the deque where idle workers can steal it. Work is split only where a
+* thief may need it, so a tree with a long spine or one heavy side still
+* divides evenly, and a balanced one is not cut into more pieces than
+* necessary.
+*
+* Each worker visits its nodes with body(node) on its own copy of body,
+* and the copies are appended to done, in no particular order, as the
+* workers finish.
+*/
+template <typename Key, typename Value>
+class ParallelTreeWalker
+{
+public:
+    static unsigned threadCount(unsigned threads);
+    static Node<Key, Value>* rootOf(const BinarySearchTree<Key, Value>& tree);
+
+    template<class Body>
+    static void walk(Node<Key, Value>* root, unsigned threads, const Body& body, std::vector<Body>& done);
+
+    // Visits chunk(i) for i in [0, count), handing out indices dynamically
+    template<class Chunk>
+    static void forEachChunk(size_t count, unsigned threads, Chunk& chunk);
+
+    // Cuts the tree depth levels below the root into the whole subtrees and
+    // single nodes between them, listed in key order
+    static void inOrderChunks(Node<Key, Value>* root, int depth,
+                              std::vector<std::pair<Node<Key, Value>*, bool> >& chunks);
+
+protected:
+    struct TaskQueue
+    {
+        TaskQueue() : size(0) {}
+        std::mutex lock;
+        std::deque<Node<Key, Value>*> tasks;
+        std::atomic<size_t> size;
+    };
+
+    struct Failure
+    {
+        Failure() : failed(false) {}
+        std::atomic<bool> failed;
+        std::mutex lock;
+        std::exception_ptr error;
+        void record();
+    };
+
+    template<class Body>
+    static void work(unsigned self, std::vector<TaskQueue>& queues, std::atomic<size_t>& outstanding,
+                     Failure& failure, Body& body);
+    static Node<Key, Value>* take(unsigned self, std::vector<TaskQueue>& queues);
+
+    template<class Worker>
+    static void runThreads(unsigned threads, Worker& worker, Failure& failure);
+};
+
+/*
+  ------------------------------------------------------
+  Begin implementations for the ParallelTreeWalker class.
+  ------------------------------------------------------
+*/
+
+template<class Key, class Value>
+unsigned ParallelTreeWalker<Key, Value>::threadCount(unsigned threads)
+{
+    if(threads == 0) threads = std::thread::hardware_concurrency();
+    return threads == 0 ? 1 : threads;
+}
+
+template<class Key, class Value>
+Node<Key, Value>* ParallelTreeWalker<Key, Value>::rootOf(const BinarySearchTree<Key, Value>& tree)
+{
+    return tree.root_;
+}
+
+template<class Key, class Value>
+void ParallelTreeWalker<Key, Value>::Failure::record()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if(!error) error = std::current_exception();
+    failed = true;
+}
+
+/*
+ * Runs worker(0) on the calling thread and worker(1..threads-1) on new ones.
+ * A thread that cannot be started only means fewer workers.
+ */
+template<class Key, class Value>
+template<class Worker>
+void ParallelTreeWalker<Key, Value>::runThreads(unsigned threads, Worker& worker, Failure& failure)
+{
+    std::vector<std::thread> pool;
+    pool.reserve(threads - 1);
+    for(unsigned t = 1; t < threads; ++t) {
+        try {
+            pool.push_back(std::thread(std::ref(worker), t));
+        }
+        catch(const std::system_error&) {
+            break;
+        }
+    }
+    worker(0);
+    for(size_t t = 0; t < pool.size(); ++t) {
+        pool[t].join();
+    }
+    if(failure.error) std::rethrow_exception(failure.error);
+}
+
+// Newest task of our own deque first, then the oldest of anyone else's
+template<class Key, class Value>
+Node<Key, Value>* ParallelTreeWalker<Key, Value>::take(unsigned self, std::vector<TaskQueue>& queues)
+{
+    unsigned count = static_cast<unsigned>(queues.size());
+    for(unsigned i = 0; i < count; ++i) {
+        TaskQueue& queue = queues[(self + i) % count];
+        if(queue.size.load(std::memory_order_relaxed) == 0) continue;
+
+        std::lock_guard<std::mutex> guard(queue.lock);
+        if(queue.tasks.empty()) continue;
+        Node<Key, Value>* task;
+        if(i == 0) {
+            task = queue.tasks.back();
+            queue.tasks.pop_back();
+        }
+        else {
+            task = queue.tasks.front();
+            queue.tasks.pop_front();
+        }
+        queue.size.store(queue.tasks.size(), std::memory_order_relaxed);
+        return task;
+    }
+    return NULL;
+}
+
+/*
+ * outstanding counts the subtrees that have been published but not yet
+ * finished. A worker finishes a task once its private stack runs dry, so
+ * the count only reaches zero when every node has been visited.
+ */
+template<class Key, class Value>
+template<class Body>
+void ParallelTreeWalker<Key, Value>::work(unsigned self, std::vector<TaskQueue>& queues,
+                                          std::atomic<size_t>& outstanding, Failure& failure, Body& body)
+{
+    std::deque<Node<Key, Value>*> pending;
+    TaskQueue& mine = queues[self];
+
+    while(!failure.failed.load(std::memory_order_relaxed)) {
+        Node<Key, Value>* task = take(self, queues);
+        if(task == NULL) {
+            if(outstanding.load() == 0) return;
+            std::this_thread::yield();
+            continue;
+        }
+
+        try {
+            pending.push_back(task);
+            while(!pending.empty() && !failure.failed.load(std::memory_order_relaxed)) {
+                Node<Key, Value>* node = pending.back();
+                pending.pop_back();
+                if(node->getRight() != NULL) pending.push_back(node->getRight());
+                if(node->getLeft() != NULL) pending.push_back(node->getLeft());
+                body(node);
+
+                if(pending.size() > 1 && mine.size.load(std::memory_order_relaxed) == 0) {
+                    outstanding.fetch_add(1);
+                    std::lock_guard<std::mutex> guard(mine.lock);
+                    mine.tasks.push_back(pending.front());
+                    mine.size.store(mine.tasks.size(), std::memory_order_relaxed);
+                    pending.pop_front();
+                }
+            }
+        }
+        catch(...) {
+            failure.record();
+            return;
+        }
+        outstanding.fetch_sub(1);
+    }
+}
+
+template<class Key, class Value>
+template<class Body>
+void ParallelTreeWalker<Key, Value>::walk(Node<Key, Value>* root, unsigned threads, const Body& body,
+                                          std::vector<Body>& done)
+{
+    if(root == NULL) return;
+
+    std::vector<TaskQueue> queues(threads);
+    std::atomic<size_t> outstanding(1);
+    std::mutex doneLock;
+    Failure failure;
+    queues[0].tasks.push_back(root);
+    queues[0].size = 1;
+
+    // the copies live on the workers' own stacks, so they share no cache lines
+    auto worker = [&](unsigned self) {
+        Body mine(body);
+        work(self, queues, outstanding, failure, mine);
+        std::lock_guard<std::mutex> guard(doneLock);
+        done.push_back(mine);
+    };
+    runThreads(threads, worker, failure);
+}
+
+template<class Key, class Value>
+template<class Chunk>
+void ParallelTreeWalker<Key, Value>::forEachChunk(size_t count, unsigned threads, Chunk& chunk)
+{
+    std::atomic<size_t> next(0);
+    Failure failure;
+    auto worker = [&](unsigned) {
+        try {
+            for(size_t i = next++; i < count && !failure.failed.load(std::memory_order_relaxed); i = next++) {
+                chunk(i);
+            }
+        }
+        catch(...) {
+            failure.record();
+        }
+    };
+    runThreads(threads, worker, failure);
+}
+
+template<class Key, class Value>
+void ParallelTreeWalker<Key, Value>::inOrderChunks(Node<Key, Value>* root, int depth,
+                                                   std::vector<std::pair<Node<Key, Value>*, bool> >& chunks)
+{
+    if(root == NULL) return;
+    if(depth == 0) {
+        chunks.push_back(std::make_pair(root, true));
+        return;
+    }
+    inOrderChunks(root->getLeft(), depth - 1, chunks);
+    chunks.push_back(std::make_pair(root, false));
+    inOrderChunks(root->getRight(), depth - 1, chunks);
+}
+
+/*
+  ----------------------------------------------------
+  End implementations for the ParallelTreeWalker class.
+  ----------------------------------------------------
+*/
+
+// ----- Helper: per-worker state for the traversals below -----
+
+template<class Key, class Value, class Func>
+struct ForEachBody
+{
+    explicit ForEachBody(const Func& f) : f_(f) {}
+    void operator()(Node<Key, Value>* node) { f_(node->getItem()); }
+    Func f_;
+};
+
+template<class Key, class Value, class Func>
+struct TransformBody
+{
+    explicit TransformBody(const Func& f) : f_(f) {}
+    void operator()(Node<Key, Value>* node)
+    {
+        node->setValue(f_(node->getKey(), node->getValue()));
+    }
+    Func f_;
+};
+
+template<class Key, class Value, class T, class Map, class Combine>
+struct ReduceBody
+{
+    ReduceBody(const T& init, const Map& map, const Combine& combine) :
+        acc_(init), map_(map), combine_(combine) {}
+    void operator()(Node<Key, Value>* node) { acc_ = combine_(acc_, map_(node->getItem())); }
+    T acc_;
+    Map map_;
+    Combine combine_;
+};
+
+template<class Key, class Value, class Func>
+void parallel_for_each(BinarySearchTree<Key, Value>& tree, Func f, unsigned threads)
+{
+    typedef ParallelTreeWalker<Key, Value> Walker;
+    std::vector<ForEachBody<Key, Value, Func> > done;
+    Walker::walk(Walker::rootOf(tree), Walker::threadCount(threads), ForEachBody<Key, Value, Func>(f), done);
+}
+
+template<class Key, class Value, class Func>
+void parallel_transform_values(BinarySearchTree<Key, Value>& tree, Func f, unsigned threads)
+{
+    typedef ParallelTreeWalker<Key, Value> Walker;
+    std::vector<TransformBody<Key, Value, Func> > done;
+    Walker::walk(Walker::rootOf(tree), Walker::threadCount(threads), TransformBody<Key, Value, Func>(f), done);
+}
+
+template<class Key, class Value, class T, class Map, class Combine>
+T parallel_reduce(const BinarySearchTree<Key, Value>& tree, T init, Map map, Combine combine,
+                  unsigned threads)
+{
+    typedef ParallelTreeWalker<Key, Value> Walker;
+    typedef ReduceBody<Key, Value, T, Map, Combine> Body;
+    std::vector<Body> done;
+    Walker::walk(Walker::rootOf(tree), Walker::threadCount(threads), Body(init, map, combine), done);
+
+    T result = init;
+    for(size_t i = 0; i < done.size(); ++i) {
+        result = combine(result, done[i].acc_);
+    }
+    return result;
+}
+
+/*
+ * Cuts the tree a fixed number of levels down into about 16 chunks per
+ * thread, folds each chunk in key order starting from its first item and
+ * then folds the chunk results in order after init. The chunks are handed out one at a time, so threads that get
+ * small ones take more of them; on an unbalanced BinarySearchTree they can
+ * still differ in size a lot more than the stealing walk allows.
+ */
+template<class Key, class Value, class T, class Map, class Combine>
+T parallel_reduce_ordered(const BinarySearchTree<Key, Value>& tree, T init, Map map, Combine combine,
+                          unsigned threads)
+{
+    typedef ParallelTreeWalker<Key, Value> Walker;
+    threads = Walker::threadCount(threads);
+
+    int depth = 0;
+    while((size_t(1) << depth) < size_t(16) * threads) ++depth;
+    std::vector<std::pair<Node<Key, Value>*, bool> > chunks;
+    Walker::inOrderChunks(Walker::rootOf(tree), depth, chunks);
+
+    std::vector<T> results(chunks.size(), init);
+    auto fold = [&](size_t i) {
+        Node<Key, Value>* node = chunks[i].first;
+        if(!chunks[i].second) {
+            results[i] = map(node->getItem());
+            return;
+        }
+        std::vector<Node<Key, Value>*> stack;
+        for(; node != NULL; node = node->getLeft()) stack.push_back(node);
+        node = stack.back();
+        stack.pop_back();
+        T acc = map(node->getItem());
+        node = node->getRight();
+        while(node != NULL || !stack.empty()) {
+            for(; node != NULL; node = node->getLeft()) stack.push_back(node);
+            node = stack.back();
+            stack.pop_back();
+            acc = combine(acc, map(node->getItem()));
+            node = node->getRight();
+        }
+        results[i] = acc;
+    };
+    Walker::forEachChunk(chunks.size(), threads, fold);
+
+    T result = init;
+    for(size_t i = 0; i < results.size(); ++i) {
+        result = combine(result, results[i]);
+    }
+    return result;
+}
+
+#endif
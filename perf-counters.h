@@ -0,0 +1,214 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <cstdint>
+#include <cstring>
+#include <chrono>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+/**
+* A small set of hardware performance counters for profiling tree operations.
+*
+* This follows the counter table in hw4_tests/testing_utils/libperf (the same
+* perf_event_open() attributes), but only opens the handful of counters we
+* care about for node layout work, and keeps them disabled outside of the
+* measured region so that setup code does not pollute the numbers.
+*
+* The counters are opened as one group led by the cycle counter, so the
+* kernel schedules them onto the PMU together and they all cover the same
+* interval. When the PMU has to multiplex the group with other events, the
+* counts are scaled up by the time the group was enabled over the time it
+* actually ran.
+*
+* Counters that the kernel or the hardware refuse to open (containers, VMs,
+* perf_event_paranoid) are reported as unavailable rather than as zero, and
+* so is everything if the group could not be read or never got to run.
+*/
+class PerfCounters
+{
+public:
+    enum Counter
+    {
+        TASK_CLOCK = 0,     // ns of CPU time spent in this task
+        CYCLES,
+        INSTRUCTIONS,
+        CACHE_MISSES,       // last level cache misses
+        BRANCH_MISSES,
+        DTLB_LOAD_MISSES,
+        NUM_COUNTERS
+    };
+
+    PerfCounters();
+    ~PerfCounters();
+
+    // reset every counter to zero and start counting
+    void start();
+    // stop counting; values stay readable until the next start()
+    void stop();
+
+    bool isAvailable(Counter c) const;
+    uint64_t read(Counter c) const;
+    static const char* name(Counter c);
+
+private:
+    PerfCounters(const PerfCounters&);
+    PerfCounters& operator=(const PerfCounters&);
+
+    int fds_[NUM_COUNTERS];
+    // the group leader's fd, and the counters in the order the group reads them
+    int leader_;
+    Counter members_[NUM_COUNTERS];
+    int numMembers_;
+    uint64_t values_[NUM_COUNTERS];
+    // false when the last stop() could not read the group or it never ran
+    bool counted_;
+    // fallback for TASK_CLOCK when perf is not available at all
+    std::chrono::steady_clock::time_point wallStart_;
+    uint64_t wallNs_;
+};
+
+/*
+  -----------------------------------------------
+  Begin implementations for the PerfCounters class.
+  -----------------------------------------------
+*/
+
+inline PerfCounters::PerfCounters() :
+    leader_(-1), numMembers_(0), counted_(true), wallNs_(0)
+{
+    for(int i = 0; i < NUM_COUNTERS; ++i) {
+        fds_[i] = -1;
+        values_[i] = 0;
+    }
+
+#ifdef __linux__
+    static const uint32_t types[NUM_COUNTERS] = {
+        PERF_TYPE_SOFTWARE,
+        PERF_TYPE_HARDWARE,
+        PERF_TYPE_HARDWARE,
+        PERF_TYPE_HARDWARE,
+        PERF_TYPE_HARDWARE,
+        PERF_TYPE_HW_CACHE
+    };
+    static const uint64_t configs[NUM_COUNTERS] = {
+        PERF_COUNT_SW_TASK_CLOCK,
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES,
+        PERF_COUNT_HW_BRANCH_MISSES,
+        (PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+    };
+    // cycles first so that it leads the group; without a PMU the task clock does
+    static const Counter openOrder[NUM_COUNTERS] = {
+        CYCLES, TASK_CLOCK, INSTRUCTIONS, CACHE_MISSES, BRANCH_MISSES, DTLB_LOAD_MISSES
+    };
+
+    for(int i = 0; i < NUM_COUNTERS; ++i) {
+        Counter c = openOrder[i];
+        struct perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = types[c];
+        attr.config = configs[c];
+        // only the leader is disabled; the members follow it
+        attr.disabled = (leader_ < 0) ? 1 : 0;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        fds_[c] = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, leader_, 0));
+        if(fds_[c] < 0) continue;
+        if(leader_ < 0) leader_ = fds_[c];
+        members_[numMembers_++] = c;
+    }
+#endif
+}
+
+inline PerfCounters::~PerfCounters()
+{
+#ifdef __linux__
+    // members first: closing the leader would make them stand alone
+    for(int i = numMembers_ - 1; i >= 0; --i) {
+        close(fds_[members_[i]]);
+    }
+#endif
+}
+
+inline void PerfCounters::start()
+{
+    for(int i = 0; i < NUM_COUNTERS; ++i) {
+        values_[i] = 0;
+    }
+    wallNs_ = 0;
+#ifdef __linux__
+    if(leader_ >= 0) {
+        ioctl(leader_, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(leader_, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+#endif
+    wallStart_ = std::chrono::steady_clock::now();
+}
+
+/*
+ * A PERF_FORMAT_GROUP read returns the number of counters, the times the
+ * group was enabled and running, then one value per counter in the order
+ * they joined the group.
+ */
+inline void PerfCounters::stop()
+{
+    std::chrono::steady_clock::time_point wallEnd = std::chrono::steady_clock::now();
+#ifdef __linux__
+    if(leader_ >= 0) {
+        ioctl(leader_, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+        uint64_t buf[3 + NUM_COUNTERS];
+        ssize_t want = static_cast<ssize_t>((3 + numMembers_) * sizeof(uint64_t));
+        counted_ = (::read(leader_, buf, sizeof(buf)) == want &&
+                    buf[0] == static_cast<uint64_t>(numMembers_) && buf[2] != 0);
+        if(counted_) {
+            double scale = static_cast<double>(buf[1]) / static_cast<double>(buf[2]);
+            for(int i = 0; i < numMembers_; ++i) {
+                values_[members_[i]] = static_cast<uint64_t>(static_cast<double>(buf[3 + i]) * scale + 0.5);
+            }
+        }
+    }
+#endif
+    wallNs_ = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(wallEnd - wallStart_).count());
+}
+
+inline bool PerfCounters::isAvailable(Counter c) const
+{
+    return c == TASK_CLOCK || (fds_[c] >= 0 && counted_);
+}
+
+inline uint64_t PerfCounters::read(Counter c) const
+{
+    if(c == TASK_CLOCK && (fds_[c] < 0 || !counted_)) return wallNs_;
+    return values_[c];
+}
+
+inline const char* PerfCounters::name(Counter c)
+{
+    static const char* names[NUM_COUNTERS] = {
+        "ns",
+        "cycles",
+        "instructions",
+        "cache-misses",
+        "branch-misses",
+        "dTLB-load-misses"
+    };
+    return names[c];
+}
+
+/*
+  ---------------------------------------------
+  End implementations for the PerfCounters class.
+  ---------------------------------------------
+*/
+
+#endif
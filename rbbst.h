@@ -0,0 +1,414 @@
+#ifndef RBBST_H
+#define RBBST_H
+
+#include <iostream>
+#include <exception>
+#include <cstdlib>
+#include <cstdint>
+#include <vector>
+#include "bst.h"
+
+/**
+* A node for a red-black tree, which adds the color as a data member.
+*/
+template <typename Key, typename Value>
+class RBNode : public Node<Key, Value>
+{
+public:
+    enum Color { RED = 0, BLACK = 1 };
+
+    RBNode(const Key& key, const Value& value, RBNode<Key, Value>* parent);
+    virtual ~RBNode();
+
+    Color getColor() const;
+    void setColor(Color color);
+
+    virtual RBNode<Key, Value>* clone(Node<Key, Value>* parent) const override;
+    virtual size_t footprint() const override;
+
+    // See AVLNode for why these are redefined.
+    virtual RBNode<Key, Value>* getParent() const override;
+    virtual RBNode<Key, Value>* getLeft() const override;
+    virtual RBNode<Key, Value>* getRight() const override;
+
+protected:
+    uint8_t color_;
+};
+
+/*
+  -----------------------------------------
+  Begin implementations for the RBNode class.
+  -----------------------------------------
+*/
+
+/**
+* New nodes start out red.
+*/
+template<class Key, class Value>
+RBNode<Key, Value>::RBNode(const Key& key, const Value& value, RBNode<Key, Value> *parent) :
+    Node<Key, Value>(key, value, parent), color_(RED)
+{
+
+}
+
+template<class Key, class Value>
+RBNode<Key, Value>::~RBNode()
+{
+
+}
+
+template<class Key, class Value>
+typename RBNode<Key, Value>::Color RBNode<Key, Value>::getColor() const
+{
+    return static_cast<Color>(color_);
+}
+
+template<class Key, class Value>
+void RBNode<Key, Value>::setColor(Color color)
+{
+    color_ = static_cast<uint8_t>(color);
+}
+
+template<class Key, class Value>
+RBNode<Key, Value> *RBNode<Key, Value>::getParent() const
+{
+    return static_cast<RBNode<Key, Value>*>(this->parent_);
+}
+
+template<class Key, class Value>
+RBNode<Key, Value> *RBNode<Key, Value>::getLeft() const
+{
+    return static_cast<RBNode<Key, Value>*>(this->left_);
+}
+
+template<class Key, class Value>
+RBNode<Key, Value> *RBNode<Key, Value>::getRight() const
+{
+    return static_cast<RBNode<Key, Value>*>(this->right_);
+}
+
+template<class Key, class Value>
+RBNode<Key, Value>* RBNode<Key, Value>::clone(Node<Key, Value>* parent) const
+{
+    RBNode<Key, Value>* node =
+        new RBNode<Key, Value>(this->getKey(), this->getValue(), static_cast<RBNode<Key, Value>*>(parent));
+    node->color_ = color_;
+    return node;
+}
+
+template<class Key, class Value>
+size_t RBNode<Key, Value>::footprint() const
+{
+    return sizeof(*this);
+}
+
+/*
+  ---------------------------------------
+  End implementations for the RBNode class.
+  ---------------------------------------
+*/
+
+/**
+* A red-black tree. It is less strictly balanced than the AVL tree (height
+* at most 2 log n) but every update does at most three rotations, and the
+* recoloring is O(1) amortized, which suits insert/remove heavy workloads.
+*/
+template <class Key, class Value>
+class RedBlackTree : public BinarySearchTree<Key, Value>
+{
+public:
+    virtual void insert(const std::pair<const Key, Value> &new_item);
+    // DSW, then recolors the result so that the invariants hold again
+    virtual void rebalance();
+    // true iff the red-black invariants hold
+    bool isValidRedBlack() const;
+protected:
+    virtual void removeNode(Node<Key,Value>* n, bool bySuccessor);
+
+    void rotateLeft(RBNode<Key,Value>* x);
+    void rotateRight(RBNode<Key,Value>* x);
+    void insertFixup(RBNode<Key,Value>* z);
+    void removeFixup(RBNode<Key,Value>* x, RBNode<Key,Value>* parent);
+    static bool isBlack(RBNode<Key,Value>* node);
+    int blackHeightOrNegOne(RBNode<Key,Value>* node) const;
+};
+
+/*
+  -----------------------------------------------
+  Begin implementations for the RedBlackTree class.
+  -----------------------------------------------
+*/
+
+template<class Key, class Value>
+void RedBlackTree<Key, Value>::insert(const std::pair<const Key, Value> &new_item)
+{
+    const Key& key = new_item.first;
+
+    Node<Key,Value>* curr = this->root_;
+    RBNode<Key,Value>* parent = NULL;
+    bool goLeft = false;
+    while(curr != NULL) {
+        parent = static_cast<RBNode<Key,Value>*>(curr);
+        if(key < curr->getKey()) {
+            curr = curr->getLeft();
+            goLeft = true;
+        }
+        else if(key > curr->getKey()) {
+            curr = curr->getRight();
+            goLeft = false;
+        }
+        else {
+            curr->setValue(new_item.second);
+            return;
+        }
+    }
+
+    RBNode<Key,Value>* node = new RBNode<Key,Value>(key, new_item.second, parent);
+    if(parent == NULL) this->root_ = node;
+    else if(goLeft) parent->setLeft(node);
+    else parent->setRight(node);
+    this->trackInsert(node);
+
+    insertFixup(node);
+}
+
+/*
+ * Like the BST removal, a node with 2 children hands its place to its
+ * predecessor (or successor). The heir takes over the node's color, so the
+ * color that leaves the tree is the heir's own, from the spot it left.
+ */
+template<class Key, class Value>
+void RedBlackTree<Key, Value>::removeNode(Node<Key,Value>* n, bool bySuccessor)
+{
+    RBNode<Key,Value>* node = static_cast<RBNode<Key,Value>*>(n);
+
+    RBNode<Key,Value>* heir = NULL;
+    bool removedBlack = isBlack(node);
+    if(node->getLeft() != NULL && node->getRight() != NULL) {
+        heir = static_cast<RBNode<Key,Value>*>(bySuccessor
+            ? BinarySearchTree<Key,Value>::successor(node)
+            : BinarySearchTree<Key,Value>::predecessor(node));
+        removedBlack = isBlack(heir);
+        heir->setColor(node->getColor());
+    }
+
+    this->trackRemove(node);
+    bool fromLeft;
+    RBNode<Key,Value>* parent =
+        static_cast<RBNode<Key,Value>*>(this->spliceOut(node, heir, fromLeft));
+    RBNode<Key,Value>* child = static_cast<RBNode<Key,Value>*>(
+        parent == NULL ? this->root_ : (fromLeft ? parent->getLeft() : parent->getRight()));
+    delete node;
+
+    if(removedBlack) removeFixup(child, parent);
+}
+
+// NULL leaves count as black
+template<class Key, class Value>
+bool RedBlackTree<Key, Value>::isBlack(RBNode<Key,Value>* node)
+{
+    return node == NULL || node->getColor() == RBNode<Key,Value>::BLACK;
+}
+
+template<class Key, class Value>
+void RedBlackTree<Key, Value>::rotateLeft(RBNode<Key,Value>* x)
+{
+    RBNode<Key,Value>* y = x->getRight();
+    RBNode<Key,Value>* p = x->getParent();
+    RBNode<Key,Value>* beta = y->getLeft();
+
+    x->setRight(beta);
+    if(beta != NULL) beta->setParent(x);
+    y->setLeft(x);
+    x->setParent(y);
+
+    y->setParent(p);
+    if(p == NULL) this->root_ = y;
+    else if(p->getLeft() == x) p->setLeft(y);
+    else p->setRight(y);
+}
+
+template<class Key, class Value>
+void RedBlackTree<Key, Value>::rotateRight(RBNode<Key,Value>* x)
+{
+    RBNode<Key,Value>* y = x->getLeft();
+    RBNode<Key,Value>* p = x->getParent();
+    RBNode<Key,Value>* beta = y->getRight();
+
+    x->setLeft(beta);
+    if(beta != NULL) beta->setParent(x);
+    y->setRight(x);
+    x->setParent(y);
+
+    y->setParent(p);
+    if(p == NULL) this->root_ = y;
+    else if(p->getLeft() == x) p->setLeft(y);
+    else p->setRight(y);
+}
+
+// ----- Restore the invariants after inserting the red node z -----
+template<class Key, class Value>
+void RedBlackTree<Key, Value>::insertFixup(RBNode<Key,Value>* z)
+{
+    while(z->getParent() != NULL && z->getParent()->getColor() == RBNode<Key,Value>::RED) {
+        RBNode<Key,Value>* p = z->getParent();
+        RBNode<Key,Value>* g = p->getParent();   // exists since the root is black
+        bool parentIsLeft = (g->getLeft() == p);
+        RBNode<Key,Value>* uncle = parentIsLeft ? g->getRight() : g->getLeft();
+
+        if(!isBlack(uncle)) {
+            // red uncle: recolor and continue from the grandparent
+            p->setColor(RBNode<Key,Value>::BLACK);
+            uncle->setColor(RBNode<Key,Value>::BLACK);
+            g->setColor(RBNode<Key,Value>::RED);
+            z = g;
+            continue;
+        }
+
+        if(parentIsLeft) {
+            if(z == p->getRight()) {
+                rotateLeft(p);
+                z = p;
+                p = z->getParent();
+            }
+            p->setColor(RBNode<Key,Value>::BLACK);
+            g->setColor(RBNode<Key,Value>::RED);
+            rotateRight(g);
+        }
+        else {
+            if(z == p->getLeft()) {
+                rotateRight(p);
+                z = p;
+                p = z->getParent();
+            }
+            p->setColor(RBNode<Key,Value>::BLACK);
+            g->setColor(RBNode<Key,Value>::RED);
+            rotateLeft(g);
+        }
+        break;
+    }
+    static_cast<RBNode<Key,Value>*>(this->root_)->setColor(RBNode<Key,Value>::BLACK);
+}
+
+// ----- Restore the invariants after removing a black node; x took its place -----
+template<class Key, class Value>
+void RedBlackTree<Key, Value>::removeFixup(RBNode<Key,Value>* x, RBNode<Key,Value>* parent)
+{
+    while(x != this->root_ && isBlack(x)) {
+        if(x == parent->getLeft()) {
+            RBNode<Key,Value>* w = parent->getRight();
+            if(!isBlack(w)) {
+                w->setColor(RBNode<Key,Value>::BLACK);
+                parent->setColor(RBNode<Key,Value>::RED);
+                rotateLeft(parent);
+                w = parent->getRight();
+            }
+            if(isBlack(w->getLeft()) && isBlack(w->getRight())) {
+                w->setColor(RBNode<Key,Value>::RED);
+                x = parent;
+                parent = x->getParent();
+            }
+            else {
+                if(isBlack(w->getRight())) {
+                    w->getLeft()->setColor(RBNode<Key,Value>::BLACK);
+                    w->setColor(RBNode<Key,Value>::RED);
+                    rotateRight(w);
+                    w = parent->getRight();
+                }
+                w->setColor(parent->getColor());
+                parent->setColor(RBNode<Key,Value>::BLACK);
+                w->getRight()->setColor(RBNode<Key,Value>::BLACK);
+                rotateLeft(parent);
+                x = static_cast<RBNode<Key,Value>*>(this->root_);
+                break;
+            }
+        }
+        else {
+            RBNode<Key,Value>* w = parent->getLeft();
+            if(!isBlack(w)) {
+                w->setColor(RBNode<Key,Value>::BLACK);
+                parent->setColor(RBNode<Key,Value>::RED);
+                rotateRight(parent);
+                w = parent->getLeft();
+            }
+            if(isBlack(w->getLeft()) && isBlack(w->getRight())) {
+                w->setColor(RBNode<Key,Value>::RED);
+                x = parent;
+                parent = x->getParent();
+            }
+            else {
+                if(isBlack(w->getLeft())) {
+                    w->getRight()->setColor(RBNode<Key,Value>::BLACK);
+                    w->setColor(RBNode<Key,Value>::RED);
+                    rotateLeft(w);
+                    w = parent->getLeft();
+                }
+                w->setColor(parent->getColor());
+                parent->setColor(RBNode<Key,Value>::BLACK);
+                w->getLeft()->setColor(RBNode<Key,Value>::BLACK);
+                rotateRight(parent);
+                x = static_cast<RBNode<Key,Value>*>(this->root_);
+                break;
+            }
+        }
+    }
+    if(x != NULL) x->setColor(RBNode<Key,Value>::BLACK);
+}
+
+/**
+* After DSW every level is full except possibly the deepest one, so coloring
+* that level red and everything above it black gives every path the same
+* black height with no red node under another.
+*/
+template<class Key, class Value>
+void RedBlackTree<Key, Value>::rebalance()
+{
+    BinarySearchTree<Key, Value>::rebalance();
+    if(this->root_ == NULL) return;
+
+    int deepest = 0;
+    for(size_t n = this->count_; n > 1; n /= 2) ++deepest;
+
+    std::vector<std::pair<RBNode<Key,Value>*, int> > stack;
+    stack.push_back(std::make_pair(static_cast<RBNode<Key,Value>*>(this->root_), 0));
+    while(!stack.empty()) {
+        RBNode<Key,Value>* node = stack.back().first;
+        int depth = stack.back().second;
+        stack.pop_back();
+
+        node->setColor(depth == deepest && depth > 0 ? RBNode<Key,Value>::RED : RBNode<Key,Value>::BLACK);
+        if(node->getLeft() != NULL) stack.push_back(std::make_pair(node->getLeft(), depth + 1));
+        if(node->getRight() != NULL) stack.push_back(std::make_pair(node->getRight(), depth + 1));
+    }
+}
+
+template<class Key, class Value>
+bool RedBlackTree<Key, Value>::isValidRedBlack() const
+{
+    RBNode<Key,Value>* root = static_cast<RBNode<Key,Value>*>(this->root_);
+    if(!isBlack(root)) return false;
+    return blackHeightOrNegOne(root) != -1;
+}
+
+// Helper: black height of the subtree if it is valid, else -1
+template<class Key, class Value>
+int RedBlackTree<Key, Value>::blackHeightOrNegOne(RBNode<Key,Value>* node) const
+{
+    if(node == NULL) return 1;
+    if(!isBlack(node) && (!isBlack(node->getLeft()) || !isBlack(node->getRight()))) return -1;
+
+    int lh = blackHeightOrNegOne(node->getLeft());
+    if(lh == -1) return -1;
+    int rh = blackHeightOrNegOne(node->getRight());
+    if(rh == -1 || lh != rh) return -1;
+
+    return lh + (isBlack(node) ? 1 : 0);
+}
+
+/*
+  ---------------------------------------------
+  End implementations for the RedBlackTree class.
+  ---------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,207 @@
+#ifndef SGBST_H
+#define SGBST_H
+
+#include <iostream>
+#include <exception>
+#include <cstdlib>
+#include <cmath>
+#include "bst.h"
+
+/**
+* A scapegoat tree: a BinarySearchTree that keeps itself balanced without
+* storing anything extra in the nodes. On top of the node count every tree
+* keeps, it only tracks the largest size since the last full rebuild.
+*
+* When an insert lands deeper than log_{1/alpha}(size), the path back up
+* must contain a "scapegoat" node whose child holds more than alpha of its
+* subtree; that subtree alone is rebuilt into perfect balance in place with
+* BinarySearchTree::rebalanceSubtree(). When removals
+* shrink the tree below alpha * maxSize the whole tree is rebuilt. Updates
+* are amortized O(log n) and lookups are worst case O(log n).
+*/
+template <class Key, class Value>
+class ScapegoatTree : public BinarySearchTree<Key, Value>
+{
+public:
+    // alpha must be in (0.5, 1); smaller is more strictly balanced
+    explicit ScapegoatTree(double alpha = 2.0 / 3.0);
+    ScapegoatTree(const ScapegoatTree& other);
+    ScapegoatTree(ScapegoatTree&& other);
+    ScapegoatTree& operator=(const ScapegoatTree& other);
+    ScapegoatTree& operator=(ScapegoatTree&& other);
+    void swap(ScapegoatTree& other);
+
+    virtual void insert(const std::pair<const Key, Value> &new_item);
+    virtual void clear();
+    // A full rebuild, which also resets the high-water mark
+    virtual void rebalance();
+
+protected:
+    int depthLimit() const;
+    static size_t subtreeSize(Node<Key, Value>* root);
+
+    virtual void removeNode(Node<Key, Value>* node, bool bySuccessor);
+
+    double alpha_;
+    size_t maxSize_;
+};
+
+/*
+  ------------------------------------------------
+  Begin implementations for the ScapegoatTree class.
+  ------------------------------------------------
+*/
+
+template<class Key, class Value>
+ScapegoatTree<Key, Value>::ScapegoatTree(double alpha) :
+    BinarySearchTree<Key, Value>(), alpha_(alpha), maxSize_(0)
+{
+    if(alpha_ <= 0.5 || alpha_ >= 1.0) alpha_ = 2.0 / 3.0;
+}
+
+template<class Key, class Value>
+ScapegoatTree<Key, Value>::ScapegoatTree(const ScapegoatTree& other) :
+    BinarySearchTree<Key, Value>(other), alpha_(other.alpha_), maxSize_(other.maxSize_)
+{
+}
+
+// The moved-from tree is left empty, with its high-water mark reset
+template<class Key, class Value>
+ScapegoatTree<Key, Value>::ScapegoatTree(ScapegoatTree&& other) :
+    BinarySearchTree<Key, Value>(std::move(other)), alpha_(other.alpha_), maxSize_(other.maxSize_)
+{
+    other.maxSize_ = 0;
+}
+
+template<class Key, class Value>
+ScapegoatTree<Key, Value>& ScapegoatTree<Key, Value>::operator=(const ScapegoatTree& other)
+{
+    if(this != &other) {
+        ScapegoatTree<Key, Value> copy(other);
+        swap(copy);
+    }
+    return *this;
+}
+
+template<class Key, class Value>
+ScapegoatTree<Key, Value>& ScapegoatTree<Key, Value>::operator=(ScapegoatTree&& other)
+{
+    if(this != &other) {
+        clear();
+        swap(other);
+    }
+    return *this;
+}
+
+template<class Key, class Value>
+void ScapegoatTree<Key, Value>::swap(ScapegoatTree& other)
+{
+    BinarySearchTree<Key, Value>::swap(other);
+    std::swap(alpha_, other.alpha_);
+    std::swap(maxSize_, other.maxSize_);
+}
+
+// Deepest an insert may land (root at depth 0) before a rebuild is needed.
+template<class Key, class Value>
+int ScapegoatTree<Key, Value>::depthLimit() const
+{
+    if(this->count_ <= 1) return 0;
+    return static_cast<int>(std::floor(std::log(static_cast<double>(this->count_)) / std::log(1.0 / alpha_)));
+}
+
+template<class Key, class Value>
+void ScapegoatTree<Key, Value>::insert(const std::pair<const Key, Value> &new_item)
+{
+    const Key& key = new_item.first;
+
+    if(this->root_ == NULL) {
+        this->root_ = new Node<Key, Value>(key, new_item.second, NULL);
+        this->trackInsert(this->root_);
+        maxSize_ = 1;
+        return;
+    }
+
+    Node<Key, Value>* curr = this->root_;
+    Node<Key, Value>* node = NULL;
+    int depth = 0;
+    while(node == NULL) {
+        ++depth;
+        if(key < curr->getKey()) {
+            if(curr->getLeft() == NULL) {
+                node = new Node<Key, Value>(key, new_item.second, curr);
+                curr->setLeft(node);
+            }
+            else curr = curr->getLeft();
+        }
+        else if(key > curr->getKey()) {
+            if(curr->getRight() == NULL) {
+                node = new Node<Key, Value>(key, new_item.second, curr);
+                curr->setRight(node);
+            }
+            else curr = curr->getRight();
+        }
+        else {
+            curr->setValue(new_item.second);
+            return;
+        }
+    }
+
+    this->trackInsert(node);
+    if(this->count_ > maxSize_) maxSize_ = this->count_;
+    if(depth <= depthLimit()) return;
+
+    // too deep: climb until a node is alpha-unbalanced by weight
+    Node<Key, Value>* child = node;
+    size_t childSize = 1;
+    Node<Key, Value>* parent = node->getParent();
+    while(parent != NULL) {
+        Node<Key, Value>* sibling = (parent->getLeft() == child) ? parent->getRight() : parent->getLeft();
+        size_t parentSize = childSize + subtreeSize(sibling) + 1;
+        if(static_cast<double>(childSize) > alpha_ * static_cast<double>(parentSize)) {
+            this->rebalanceSubtree(parent);
+            return;
+        }
+        child = parent;
+        childSize = parentSize;
+        parent = parent->getParent();
+    }
+}
+
+template<class Key, class Value>
+void ScapegoatTree<Key, Value>::removeNode(Node<Key, Value>* node, bool bySuccessor)
+{
+    BinarySearchTree<Key, Value>::removeNode(node, bySuccessor);
+
+    if(static_cast<double>(this->count_) < alpha_ * static_cast<double>(maxSize_)) {
+        rebalance();
+    }
+}
+
+template<class Key, class Value>
+void ScapegoatTree<Key, Value>::rebalance()
+{
+    BinarySearchTree<Key, Value>::rebalance();
+    maxSize_ = this->count_;
+}
+
+template<class Key, class Value>
+void ScapegoatTree<Key, Value>::clear()
+{
+    BinarySearchTree<Key, Value>::clear();
+    maxSize_ = 0;
+}
+
+template<class Key, class Value>
+size_t ScapegoatTree<Key, Value>::subtreeSize(Node<Key, Value>* root)
+{
+    if(root == NULL) return 0;
+    return 1 + subtreeSize(root->getLeft()) + subtreeSize(root->getRight());
+}
+
+/*
+  ----------------------------------------------
+  End implementations for the ScapegoatTree class.
+  ----------------------------------------------
+*/
+
+#endif
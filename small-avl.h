@@ -0,0 +1,450 @@
+#ifndef SMALL_AVL_H
+#define SMALL_AVL_H
+
+#include <iostream>
+#include <exception>
+#include <stdexcept>
+#include <cstdlib>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include "avlbst.h"
+
+/**
+* An ordered map that keeps up to N items inline, with no heap allocation at
+* all, and only becomes an AVLTree once it outgrows that.
+*
+* The inline items sit in fixed slots and never move; a byte array lists
+* the slots in key order, so lookups scan it with a few comparisons in one
+* or two cache lines and inserts only shift the bytes. Inserting the
+* (N+1)th key moves every item into the tree, and a removal that leaves N/2
+* items moves them back, so a map hovering around N does not flip on every
+* update.
+*
+* Like a std::vector, any insert or remove may invalidate iterators and
+* references: the items move whenever the storage switches.
+*/
+template <class Key, class Value, size_t N = 16>
+class SmallAVLTree
+{
+public:
+    typedef std::pair<const Key, Value> Item;
+    typedef typename AVLTree<Key, Value>::iterator TreeIterator;
+
+    class iterator
+    {
+    public:
+        iterator();
+
+        Item& operator*() const;
+        Item* operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+
+    protected:
+        friend class SmallAVLTree<Key, Value, N>;
+        iterator(const SmallAVLTree<Key, Value, N>* owner, size_t index);
+        explicit iterator(const TreeIterator& node);
+
+        const SmallAVLTree<Key, Value, N>* owner_;
+        size_t index_;
+        TreeIterator node_;
+    };
+
+    SmallAVLTree();
+    SmallAVLTree(const SmallAVLTree& other);
+    SmallAVLTree(SmallAVLTree&& other);
+    ~SmallAVLTree();
+    SmallAVLTree& operator=(const SmallAVLTree& other);
+    SmallAVLTree& operator=(SmallAVLTree&& other);
+    void swap(SmallAVLTree& other);
+
+    void insert(const Item& new_item);
+    void remove(const Key& key);
+    void clear();
+
+    size_t size() const;
+    bool empty() const;
+    // true while the items are stored inline rather than in the tree
+    bool isInline() const;
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    Value& operator[](const Key& key);
+    Value const & operator[](const Key& key) const;
+
+protected:
+    typedef typename std::aligned_storage<sizeof(Item), std::alignment_of<Item>::value>::type Slot;
+
+    Item* slot(size_t position) const;
+    size_t lowerBound(const Key& key) const;
+    void promote();
+    void demote();
+    void destroyInline();
+
+    // order_[0, count_) are the used slots in key order, the rest are free
+    mutable Slot slots_[N];
+    unsigned char order_[N];
+    size_t count_;
+    AVLTree<Key, Value> tree_;
+    bool inline_;
+
+    static_assert(N > 0 && N <= 255, "SmallAVLTree keeps slot numbers in bytes");
+};
+
+/*
+  --------------------------------------------------------
+  Begin implementations for the SmallAVLTree::iterator class.
+  --------------------------------------------------------
+*/
+
+template<class Key, class Value, size_t N>
+SmallAVLTree<Key, Value, N>::iterator::iterator() :
+    owner_(NULL), index_(0), node_()
+{
+
+}
+
+template<class Key, class Value, size_t N>
+SmallAVLTree<Key, Value, N>::iterator::iterator(const SmallAVLTree<Key, Value, N>* owner, size_t index) :
+    owner_(owner), index_(index), node_()
+{
+    // the inline end is the same as a default constructed iterator
+    if(index_ == owner_->count_) {
+        owner_ = NULL;
+        index_ = 0;
+    }
+}
+
+template<class Key, class Value, size_t N>
+SmallAVLTree<Key, Value, N>::iterator::iterator(const TreeIterator& node) :
+    owner_(NULL), index_(0), node_(node)
+{
+
+}
+
+template<class Key, class Value, size_t N>
+typename SmallAVLTree<Key, Value, N>::Item&
+SmallAVLTree<Key, Value, N>::iterator::operator*() const
+{
+    if(owner_ != NULL) return *owner_->slot(index_);
+    return *node_;
+}
+
+template<class Key, class Value, size_t N>
+typename SmallAVLTree<Key, Value, N>::Item*
+SmallAVLTree<Key, Value, N>::iterator::operator->() const
+{
+    return &(**this);
+}
+
+template<class Key, class Value, size_t N>
+bool SmallAVLTree<Key, Value, N>::iterator::operator==(const iterator& rhs) const
+{
+    return owner_ == rhs.owner_ && index_ == rhs.index_ && node_ == rhs.node_;
+}
+
+template<class Key, class Value, size_t N>
+bool SmallAVLTree<Key, Value, N>::iterator::operator!=(const iterator& rhs) const
+{
+    return !(*this == rhs);
+}
+
+template<class Key, class Value, size_t N>
+typename SmallAVLTree<Key, Value, N>::iterator&
+SmallAVLTree<Key, Value, N>::iterator::operator++()
+{
+    if(owner_ != NULL) *this = iterator(owner_, index_ + 1);
+    else ++node_;
+    return *this;
+}
+
+/*
+  ------------------------------------------------------
+  End implementations for the SmallAVLTree::iterator class.
+  ------------------------------------------------------
+*/
+
+/*
+  -----------------------------------------------
+  Begin implementations for the SmallAVLTree class.
+  -----------------------------------------------
+*/
+
+template<class Key, class Value, size_t N>
+SmallAVLTree<Key, Value, N>::SmallAVLTree() :
+    count_(0), tree_(), inline_(true)
+{
+    for(size_t i = 0; i < N; ++i) order_[i] = static_cast<unsigned char>(i);
+}
+
+template<class Key, class Value, size_t N>
+SmallAVLTree<Key, Value, N>::SmallAVLTree(const SmallAVLTree& other) :
+    count_(0), tree_(other.tree_), inline_(other.inline_)
+{
+    for(size_t i = 0; i < N; ++i) order_[i] = static_cast<unsigned char>(i);
+    try {
+        for(; count_ < other.count_; ++count_) {
+            new (slot(count_)) Item(*other.slot(count_));
+        }
+    }
+    catch(...) {
+        destroyInline();
+        throw;
+    }
+}
+
+template<class Key, class Value, size_t N>
+SmallAVLTree<Key, Value, N>::SmallAVLTree(SmallAVLTree&& other) :
+    count_(0), tree_(std::move(other.tree_)), inline_(other.inline_)
+{
+    for(size_t i = 0; i < N; ++i) order_[i] = static_cast<unsigned char>(i);
+    try {
+        for(; count_ < other.count_; ++count_) {
+            new (slot(count_)) Item(std::move(*other.slot(count_)));
+        }
+    }
+    catch(...) {
+        destroyInline();
+        throw;
+    }
+    other.clear();
+}
+
+template<class Key, class Value, size_t N>
+SmallAVLTree<Key, Value, N>::~SmallAVLTree()
+{
+    destroyInline();
+}
+
+template<class Key, class Value, size_t N>
+SmallAVLTree<Key, Value, N>& SmallAVLTree<Key, Value, N>::operator=(const SmallAVLTree& other)
+{
+    if(this != &other) {
+        SmallAVLTree<Key, Value, N> copy(other);
+        swap(copy);
+    }
+    return *this;
+}
+
+template<class Key, class Value, size_t N>
+SmallAVLTree<Key, Value, N>& SmallAVLTree<Key, Value, N>::operator=(SmallAVLTree&& other)
+{
+    if(this != &other) {
+        SmallAVLTree<Key, Value, N> taken(std::move(other));
+        swap(taken);
+    }
+    return *this;
+}
+
+/**
+* The trees swap in O(1); inline items are moved, at most N each way.
+*/
+template<class Key, class Value, size_t N>
+void SmallAVLTree<Key, Value, N>::swap(SmallAVLTree& other)
+{
+    if(this == &other) return;
+    SmallAVLTree<Key, Value, N> mine(std::move(*this));
+    for(; count_ < other.count_; ++count_) {
+        new (slot(count_)) Item(std::move(*other.slot(count_)));
+    }
+    tree_.swap(other.tree_);
+    inline_ = other.inline_;
+    other.clear();
+    for(; other.count_ < mine.count_; ++other.count_) {
+        new (other.slot(other.count_)) Item(std::move(*mine.slot(other.count_)));
+    }
+    other.tree_.swap(mine.tree_);
+    other.inline_ = mine.inline_;
+}
+
+template<class Key, class Value, size_t N>
+void SmallAVLTree<Key, Value, N>::insert(const Item& new_item)
+{
+    if(!inline_) {
+        tree_.insert(new_item);
+        return;
+    }
+
+    size_t pos = lowerBound(new_item.first);
+    if(pos < count_ && !(new_item.first < slot(pos)->first)) {
+        slot(pos)->second = new_item.second;
+        return;
+    }
+    if(count_ == N) {
+        promote();
+        tree_.insert(new_item);
+        return;
+    }
+
+    unsigned char free = order_[count_];
+    new (&slots_[free]) Item(new_item);
+    for(size_t i = count_; i > pos; --i) order_[i] = order_[i - 1];
+    order_[pos] = free;
+    ++count_;
+}
+
+template<class Key, class Value, size_t N>
+void SmallAVLTree<Key, Value, N>::remove(const Key& key)
+{
+    if(!inline_) {
+        tree_.remove(key);
+        if(tree_.size() <= N / 2) demote();
+        return;
+    }
+
+    size_t pos = lowerBound(key);
+    if(pos == count_ || key < slot(pos)->first) return;
+
+    unsigned char used = order_[pos];
+    slot(pos)->~Item();
+    for(size_t i = pos + 1; i < count_; ++i) order_[i - 1] = order_[i];
+    --count_;
+    order_[count_] = used;
+}
+
+template<class Key, class Value, size_t N>
+void SmallAVLTree<Key, Value, N>::clear()
+{
+    destroyInline();
+    tree_.clear();
+    inline_ = true;
+}
+
+template<class Key, class Value, size_t N>
+size_t SmallAVLTree<Key, Value, N>::size() const
+{
+    return inline_ ? count_ : tree_.size();
+}
+
+template<class Key, class Value, size_t N>
+bool SmallAVLTree<Key, Value, N>::empty() const
+{
+    return size() == 0;
+}
+
+template<class Key, class Value, size_t N>
+bool SmallAVLTree<Key, Value, N>::isInline() const
+{
+    return inline_;
+}
+
+template<class Key, class Value, size_t N>
+typename SmallAVLTree<Key, Value, N>::iterator
+SmallAVLTree<Key, Value, N>::begin() const
+{
+    if(!inline_) return iterator(tree_.begin());
+    return iterator(this, 0);
+}
+
+template<class Key, class Value, size_t N>
+typename SmallAVLTree<Key, Value, N>::iterator
+SmallAVLTree<Key, Value, N>::end() const
+{
+    return iterator();
+}
+
+template<class Key, class Value, size_t N>
+typename SmallAVLTree<Key, Value, N>::iterator
+SmallAVLTree<Key, Value, N>::find(const Key& key) const
+{
+    if(!inline_) {
+        TreeIterator it = tree_.find(key);
+        return it == tree_.end() ? end() : iterator(it);
+    }
+    size_t pos = lowerBound(key);
+    if(pos == count_ || key < slot(pos)->first) return end();
+    return iterator(this, pos);
+}
+
+template<class Key, class Value, size_t N>
+Value& SmallAVLTree<Key, Value, N>::operator[](const Key& key)
+{
+    iterator it = find(key);
+    if(it == end()) throw std::out_of_range("Invalid key");
+    return it->second;
+}
+
+template<class Key, class Value, size_t N>
+Value const & SmallAVLTree<Key, Value, N>::operator[](const Key& key) const
+{
+    iterator it = find(key);
+    if(it == end()) throw std::out_of_range("Invalid key");
+    return it->second;
+}
+
+// ----- Helper: the item at a position in key order -----
+template<class Key, class Value, size_t N>
+typename SmallAVLTree<Key, Value, N>::Item* SmallAVLTree<Key, Value, N>::slot(size_t position) const
+{
+    return reinterpret_cast<Item*>(&slots_[order_[position]]);
+}
+
+/*
+ * First position whose key is not less than key. A plain scan: for the
+ * handful of items kept inline it beats a binary search, whose branches
+ * cannot be predicted.
+ */
+template<class Key, class Value, size_t N>
+size_t SmallAVLTree<Key, Value, N>::lowerBound(const Key& key) const
+{
+    size_t pos = 0;
+    while(pos < count_ && slot(pos)->first < key) ++pos;
+    return pos;
+}
+
+/*
+ * The inline items are already sorted, so each one is appended at the end
+ * of the tree. If that runs out of memory the tree is dropped and the
+ * items stay inline.
+ */
+template<class Key, class Value, size_t N>
+void SmallAVLTree<Key, Value, N>::promote()
+{
+    try {
+        for(size_t i = 0; i < count_; ++i) tree_.append_back(*slot(i));
+    }
+    catch(...) {
+        tree_.clear();
+        throw;
+    }
+    destroyInline();
+    inline_ = false;
+}
+
+// Moves the items back inline; on failure they simply stay in the tree.
+template<class Key, class Value, size_t N>
+void SmallAVLTree<Key, Value, N>::demote()
+{
+    try {
+        for(TreeIterator it = tree_.begin(); it != tree_.end(); ++it) {
+            new (slot(count_)) Item(*it);
+            ++count_;
+        }
+    }
+    catch(...) {
+        destroyInline();
+        return;
+    }
+    tree_.clear();
+    inline_ = true;
+}
+
+template<class Key, class Value, size_t N>
+void SmallAVLTree<Key, Value, N>::destroyInline()
+{
+    for(size_t i = 0; i < count_; ++i) slot(i)->~Item();
+    count_ = 0;
+}
+
+/*
+  ---------------------------------------------
+  End implementations for the SmallAVLTree class.
+  ---------------------------------------------
+*/
+
+#endif
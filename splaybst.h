@@ -0,0 +1,211 @@
+#ifndef SPLAYBST_H
+#define SPLAYBST_H
+
+#include <iostream>
+#include <exception>
+#include <cstdlib>
+#include "bst.h"
+
+/**
+* A self-adjusting binary search tree. Every access semi-splays the touched
+* node (see splay()), so frequently used keys drift towards the top; all
+* operations are amortized O(log n). It uses the plain Node class since no
+* per-node data is needed.
+*
+* It is not a fast path for skewed reads. On bst-perf, both with Zipf(0.99)
+* keys and with 5% of the keys getting 90% of the lookups, find() is about
+* 2x slower than AVLTree::find with 16K keys and about 1.4x slower with
+* 256K: the rotations, which write to several nodes per level, cost more
+* than the few levels they save. Skipping the splay for shallow nodes did
+* not change that, nor did hot sets as small as 16 keys. Use it where the
+* restructuring itself is wanted (e.g. to keep the recently used keys
+* together), not for speed.
+*
+* Note that find() and operator[] restructure the tree, so they are
+* non-const here; the const overloads inherited from BinarySearchTree still
+* work on a const tree but do not splay.
+*/
+template <class Key, class Value>
+class SplayTree : public BinarySearchTree<Key, Value>
+{
+public:
+    typedef typename BinarySearchTree<Key, Value>::iterator iterator;
+
+    virtual void insert(const std::pair<const Key, Value> &new_item);
+    virtual void remove(const Key& key);
+
+    using BinarySearchTree<Key, Value>::find;
+    using BinarySearchTree<Key, Value>::operator[];
+    iterator find(const Key& key);
+    Value& operator[](const Key& key);
+
+protected:
+    // lifts x above its parent
+    void rotateUp(Node<Key, Value>* x);
+    void splay(Node<Key, Value>* x);
+    // finds key, or the last node on its search path, and splays it
+    Node<Key, Value>* splayFind(const Key& key);
+};
+
+/*
+  --------------------------------------------
+  Begin implementations for the SplayTree class.
+  --------------------------------------------
+*/
+
+template<class Key, class Value>
+void SplayTree<Key, Value>::insert(const std::pair<const Key, Value> &new_item)
+{
+    const Key& key = new_item.first;
+
+    if(this->root_ == NULL) {
+        this->root_ = new Node<Key, Value>(key, new_item.second, NULL);
+        this->trackInsert(this->root_);
+        return;
+    }
+
+    Node<Key, Value>* curr = this->root_;
+    while(true) {
+        if(key < curr->getKey()) {
+            if(curr->getLeft() == NULL) {
+                Node<Key, Value>* node = new Node<Key, Value>(key, new_item.second, curr);
+                curr->setLeft(node);
+                this->trackInsert(node);
+                curr = node;
+                break;
+            }
+            curr = curr->getLeft();
+        }
+        else if(key > curr->getKey()) {
+            if(curr->getRight() == NULL) {
+                Node<Key, Value>* node = new Node<Key, Value>(key, new_item.second, curr);
+                curr->setRight(node);
+                this->trackInsert(node);
+                curr = node;
+                break;
+            }
+            curr = curr->getRight();
+        }
+        else {
+            curr->setValue(new_item.second);
+            break;
+        }
+    }
+    splay(curr);
+}
+
+/*
+ * Splays the node up first, so the BST removal (predecessor splice) starts
+ * near the top and its own lookup is short.
+ */
+template<class Key, class Value>
+void SplayTree<Key, Value>::remove(const Key& key)
+{
+    Node<Key, Value>* node = splayFind(key);
+    if(node == NULL || node->getKey() < key || key < node->getKey()) return;
+    BinarySearchTree<Key, Value>::remove(key);
+}
+
+template<class Key, class Value>
+typename SplayTree<Key, Value>::iterator SplayTree<Key, Value>::find(const Key& key)
+{
+    Node<Key, Value>* node = splayFind(key);
+    if(node == NULL || node->getKey() < key || key < node->getKey()) return this->end();
+    return BinarySearchTree<Key, Value>::iteratorAt(node);
+}
+
+template<class Key, class Value>
+Value& SplayTree<Key, Value>::operator[](const Key& key)
+{
+    Node<Key, Value>* node = splayFind(key);
+    if(node == NULL || node->getKey() < key || key < node->getKey()) {
+        throw std::out_of_range("Invalid key");
+    }
+    return node->getValue();
+}
+
+template<class Key, class Value>
+Node<Key, Value>* SplayTree<Key, Value>::splayFind(const Key& key)
+{
+    Node<Key, Value>* curr = this->root_;
+    Node<Key, Value>* last = NULL;
+    while(curr != NULL) {
+        last = curr;
+        if(key < curr->getKey()) curr = curr->getLeft();
+        else if(key > curr->getKey()) curr = curr->getRight();
+        else break;
+    }
+    splay(last);
+    return last;
+}
+
+template<class Key, class Value>
+void SplayTree<Key, Value>::rotateUp(Node<Key, Value>* x)
+{
+    Node<Key, Value>* p = x->getParent();
+    Node<Key, Value>* g = p->getParent();
+
+    if(p->getLeft() == x) {
+        Node<Key, Value>* beta = x->getRight();
+        p->setLeft(beta);
+        if(beta != NULL) beta->setParent(p);
+        x->setRight(p);
+    }
+    else {
+        Node<Key, Value>* beta = x->getLeft();
+        p->setRight(beta);
+        if(beta != NULL) beta->setParent(p);
+        x->setLeft(p);
+    }
+    p->setParent(x);
+
+    x->setParent(g);
+    if(g == NULL) {
+        this->root_ = x;
+    }
+    else if(g->getLeft() == p) {
+        g->setLeft(x);
+    }
+    else {
+        g->setRight(x);
+    }
+}
+
+/**
+* Semi-splaying (Sleator and Tarjan): a zig-zig step only lifts the parent
+* and carries on from there, so x ends up about halfway up rather than at
+* the root. The amortized bound is the same as for full splaying, with
+* about half the rotations; on bst-perf that makes lookups 10-15% faster
+* with 256K keys and makes no difference with 16K.
+*/
+template<class Key, class Value>
+void SplayTree<Key, Value>::splay(Node<Key, Value>* x)
+{
+    if(x == NULL) return;
+    while(x->getParent() != NULL) {
+        Node<Key, Value>* p = x->getParent();
+        Node<Key, Value>* g = p->getParent();
+        if(g == NULL) {
+            // zig
+            rotateUp(x);
+        }
+        else if((g->getLeft() == p) == (p->getLeft() == x)) {
+            // zig-zig: lift the parent only
+            rotateUp(p);
+            x = p;
+        }
+        else {
+            // zig-zag
+            rotateUp(x);
+            rotateUp(x);
+        }
+    }
+}
+
+/*
+  ------------------------------------------
+  End implementations for the SplayTree class.
+  ------------------------------------------
+*/
+
+#endif